@@ -1,5 +1,10 @@
 #!/bin/bash
 set -e
 mkdir -p bin
-clang++ `sdl2-config --cflags --libs` -lSDL2 -lSDL2_mixer -o bin/Celeste src/celeste.cpp src/main.cpp src/p8.cpp
+clang++ `sdl2-config --cflags --libs` -lSDL2 -lSDL2_mixer -o bin/Celeste src/celeste.cpp src/main.cpp src/bands.cpp src/osd.cpp src/p8.cpp src/p8gfx.cpp src/pacer.cpp src/render.cpp src/rewind.cpp src/replay.cpp src/timing.cpp
+clang++ -O2 -pthread -o bin/celeste-headless src/celeste.cpp src/headless.cpp src/noaudio.cpp src/p8.cpp src/p8gfx.cpp src/rewind.cpp src/replay.cpp
+clang++ -O2 -pthread -o bin/celeste-solver src/celeste.cpp src/solver.cpp src/noaudio.cpp src/p8.cpp src/p8gfx.cpp src/replay.cpp
+clang++ -O2 -shared -fPIC -ftls-model=initial-exec -pthread -o bin/libceleste-env.so src/celeste.cpp src/env.cpp src/noaudio.cpp src/p8.cpp src/p8gfx.cpp
+clang++ -O2 -pthread -o bin/bench src/bench.cpp src/bands.cpp src/noaudio.cpp src/p8.cpp
+clang++ -O2 -pthread -o bin/celeste-golden src/celeste.cpp src/bands.cpp src/golden.cpp src/osd.cpp src/noaudio.cpp src/p8.cpp src/p8gfx.cpp
 ./bin/Celeste
@@ -0,0 +1,106 @@
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "bands.h"
+
+struct BANDS {
+    int threads;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    int generation, running;
+    bool quit;
+
+    // the job of the current generation
+    P8DLIST const *list; // NULL when presenting
+    unsigned char *screen;
+    uint32_t *dst;
+    int pitch, scale;
+    uint32_t const *lut;
+};
+
+static void band_work(BANDS *b, int band) {
+    int y0 = PICO8_H * band / b->threads, y1 = PICO8_H * (band + 1) / b->threads;
+    unsigned char *screen = p8gfx_screen;
+    p8gfx_screen = b->screen;
+    if (b->list)
+        p8gfx_play_rows(b->list, y0, y1);
+    else
+        p8gfx_present_rows(b->dst, b->pitch, b->scale, b->lut, y0, y1);
+    p8gfx_screen = screen;
+}
+
+static void band_thread(BANDS *b, int band) {
+    int generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(b->lock);
+            b->wake.wait(lock, [&] { return b->quit || b->generation != generation; });
+            if (b->quit)
+                return;
+            generation = b->generation;
+        }
+        band_work(b, band);
+        std::lock_guard<std::mutex> lock(b->lock);
+        if (--b->running == 0)
+            b->done.notify_one();
+    }
+}
+
+BANDS *bands_create(int threads) {
+    BANDS *b = new BANDS();
+    b->threads = threads < 1 ? 1 : threads > PICO8_H ? PICO8_H : threads;
+    b->generation = b->running = 0;
+    b->quit = false;
+    try {
+        for (int t = 1; t < b->threads; t++)
+            b->workers.emplace_back(band_thread, b, t);
+    } catch (...) {
+        b->threads = (int)b->workers.size() + 1; // carry on with the ones that started
+    }
+    return b;
+}
+
+void bands_destroy(BANDS *b) {
+    {
+        std::lock_guard<std::mutex> lock(b->lock);
+        b->quit = true;
+    }
+    b->wake.notify_all();
+    for (std::thread &t : b->workers)
+        t.join();
+    delete b;
+}
+
+// runs the job set up in `b` on every band, the calling thread takes band 0
+static void run(BANDS *b) {
+    {
+        std::lock_guard<std::mutex> lock(b->lock);
+        b->running = b->threads - 1;
+        b->generation++;
+    }
+    b->wake.notify_all();
+    band_work(b, 0);
+    std::unique_lock<std::mutex> lock(b->lock);
+    b->done.wait(lock, [&] { return b->running == 0; });
+}
+
+void bands_play(BANDS *b, P8DLIST const *list, unsigned char *screen) {
+    if (list->failed)
+        return;
+    b->list = list;
+    b->screen = screen;
+    run(b);
+}
+
+void bands_present(BANDS *b, unsigned char *screen, uint32_t *dst, int pitch, int scale, uint32_t const lut[16]) {
+    b->list = NULL;
+    b->screen = screen;
+    b->dst = dst;
+    b->pitch = pitch;
+    b->scale = scale;
+    b->lut = lut;
+    run(b);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "p8gfx.h"
+
+// band-parallel rasterization: the screen is cut into horizontal bands, one
+// per thread, and each thread plays the commands of a display list over its
+// own band. the commands keep their order within a band, and no two threads
+// write the same rows, so the result is the same as playing the list once.
+// the upscale to the output is split the same way.
+
+typedef struct BANDS BANDS;
+
+// `threads` includes the calling thread, which draws the first band
+BANDS *bands_create(int threads);
+
+void bands_destroy(BANDS *b);
+
+// draws `list` into `screen`. the draw palette of every thread is left as
+// recorded, a failed list draws nothing
+void bands_play(BANDS *b, P8DLIST const *list, unsigned char *screen);
+
+// p8gfx_present() of `screen`
+void bands_present(BANDS *b, unsigned char *screen, uint32_t *dst, int pitch, int scale, uint32_t const lut[16]);
@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+// the kernels are static, so the benchmarks are built into the same
+// translation unit as the renderer and the game
+#include "p8gfx.cpp"
+#include "celeste.cpp"
+#undef this
+
+#include "bands.h"
+#include "tools.h"
+
+// microbenchmarks of the renderer and collision kernels. every benchmark runs
+// a fixed scene: the same sprites, rectangles, lines and query positions on
+// every run and on every machine, so that numbers from before and after a
+// change can be compared. each one is warmed up, then timed over several
+// samples of at least a few milliseconds each. the results are printed as
+// csv, one line per benchmark:
+//
+//   name,ops,ns_per_op,min_ns_per_op,mops_per_s
+//
+// where ops is the number of operations per sample, ns_per_op the median
+// over the samples and min_ns_per_op the fastest sample.
+
+// fixed scenes //
+//////////////////
+
+#define SCENE_SIZE 256
+
+// the room used by the map and collision benchmarks (level index 10), with spikes,
+// fall floors, a balloon and a moving platform
+#define BENCH_ROOM_X 2
+#define BENCH_ROOM_Y 1
+#define BENCH_LEVEL (BENCH_ROOM_X + BENCH_ROOM_Y * 8)
+
+// the output of the band-parallel upscale, 1024x1024
+#define PRESENT_SCALE 8
+
+typedef struct {
+    int x0, y0, x1, y1;
+    int arg; // sprite, colour or radius
+} ITEM;
+
+static ITEM sprites[SCENE_SIZE]; // partly off screen on every side
+static ITEM rects[SCENE_SIZE];
+static ITEM lines[SCENE_SIZE];   // some crossing the edges, some axis aligned
+static ITEM circles[SCENE_SIZE]; // radii 0..8
+static ITEM queries[SCENE_SIZE]; // hitbox positions in and around the room, in pixels, and speeds
+
+static char const text[] = "the quick brown fox jumps over the lazy dog 0123456789";
+
+static unsigned screen[PICO8_W * PICO8_H / sizeof(unsigned)];
+static volatile int sink;
+
+static CelesteContext *ctx;
+static OBJ *player, player_start;
+static OBJ message; // of the memorial room, all of it shown, next to the player
+
+static P8DLIST frame_list; // a whole frame of the game
+static BANDS *pool;        // of the band benchmark being run
+static uint32_t *output;
+
+static int scene_rnd(unsigned *state, int lo, int hi) {
+    return lo + (int)(xorshift32(state) % (unsigned)(hi - lo));
+}
+
+static void build_scenes(void) {
+    unsigned s = 0x2545f491;
+    for (int i = 0; i < SCENE_SIZE; i++) {
+        sprites[i] = (ITEM){scene_rnd(&s, -8, 129), scene_rnd(&s, -8, 129), 0, 0, scene_rnd(&s, 1, 128)};
+
+        int x = scene_rnd(&s, -16, 128), y = scene_rnd(&s, -16, 128);
+        rects[i] = (ITEM){x, y, x + scene_rnd(&s, 0, 40), y + scene_rnd(&s, 0, 40), scene_rnd(&s, 0, 16)};
+
+        ITEM *l = &lines[i];
+        *l = (ITEM){scene_rnd(&s, -32, 160), scene_rnd(&s, -32, 160), scene_rnd(&s, -32, 160),
+                    scene_rnd(&s, -32, 160), scene_rnd(&s, 1, 16)};
+        if (i % 4 == 1)
+            l->y1 = l->y0;
+        else if (i % 4 == 2)
+            l->x1 = l->x0;
+
+        circles[i] = (ITEM){scene_rnd(&s, -4, 132), scene_rnd(&s, -4, 132), 0, 0, i % 9};
+
+        queries[i] = (ITEM){scene_rnd(&s, -8, 136), scene_rnd(&s, -8, 136), scene_rnd(&s, -4, 5),
+                            scene_rnd(&s, -4, 5), 0};
+    }
+}
+
+static bool setup(char const *data_dir) {
+    if (!p8gfx_load_sheets(data_dir))
+        return false;
+    p8gfx_screen = (unsigned char *)screen;
+
+    // the level of the other benchmarks, a second after it starts
+    CelesteContext *game = Celeste_P8_create();
+    if (!game)
+        return false;
+    Celeste_P8_set_rndseed(game, 1);
+    Celeste_P8_init(game);
+    CelesteProgress progress;
+    bool skip = true;
+    do {
+        if (skip)
+            Celeste_P8__DEBUG(game);
+        Celeste_P8_update(game);
+        Celeste_P8_draw(game);
+        Celeste_P8_get_progress(game, &progress);
+        skip = progress.level != 31; // the title screen, starting the game
+    } while (progress.level != BENCH_LEVEL);
+    for (int i = 0; i < 30; i++) {
+        Celeste_P8_update(game);
+        Celeste_P8_draw(game);
+    }
+    p8gfx_record(&frame_list);
+    Celeste_P8_draw(game);
+    p8gfx_record(NULL);
+    Celeste_P8_destroy(game);
+    output = (uint32_t *)malloc(PICO8_W * PICO8_H * PRESENT_SCALE * PRESENT_SCALE * sizeof *output);
+
+    ctx = Celeste_P8_create();
+    if (!ctx)
+        return false;
+    bind(ctx);
+    load_room(BENCH_ROOM_X, BENCH_ROOM_Y);
+    player = init_object(OBJ_PLAYER, 64, 64);
+    player_start = *player;
+    // not one of the objects of the room, only drawn
+    OBJ *m = init_object(OBJ_MESSAGE, player->x - 4, player->y);
+    do
+        MESSAGE_draw(m);
+    while (m->message.index < strlen(m->message.text));
+    message = *m;
+    destroy_object(m);
+    build_scenes();
+    return true;
+}
+
+// benchmarks //
+////////////////
+
+// every function runs the whole scene once and returns the number of
+// operations done
+
+static long bench_blit(int color, bool flipx, bool flipy) {
+    for (int i = 0; i < SCENE_SIZE; i++) {
+        ITEM const *s = &sprites[i];
+        blit(&gfx, s->arg, s->x0, s->y0, color, flipx, flipy);
+    }
+    return SCENE_SIZE;
+}
+
+static long bench_blit_plain(void) {
+    return bench_blit(0, false, false);
+}
+
+static long bench_blit_flipx(void) {
+    return bench_blit(0, true, false);
+}
+
+static long bench_blit_flipy(void) {
+    return bench_blit(0, false, true);
+}
+
+static long bench_blit_color(void) {
+    return bench_blit(7, false, false);
+}
+
+static long bench_blit_color_flipx(void) {
+    return bench_blit(7, true, false);
+}
+
+// a fake wall per operation, a region of 2x2 tiles
+static long bench_spr_2x2(void) {
+    for (int i = 0; i < SCENE_SIZE; i++)
+        p8gfx_spr(64, sprites[i].x0, sprites[i].y0, 2, 2, false, false);
+    return SCENE_SIZE;
+}
+
+static long bench_rectfill(void) {
+    for (int i = 0; i < SCENE_SIZE; i++)
+        p8gfx_rectfill(rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1, rects[i].arg);
+    return SCENE_SIZE;
+}
+
+static long bench_line(void) {
+    for (int i = 0; i < SCENE_SIZE; i++)
+        p8gfx_line(lines[i].x0, lines[i].y0, lines[i].x1, lines[i].y1, lines[i].arg);
+    return SCENE_SIZE;
+}
+
+static long bench_circfill(void) {
+    for (int i = 0; i < SCENE_SIZE; i++)
+        p8gfx_circfill(circles[i].x0, circles[i].y0, circles[i].arg, i % 16);
+    return SCENE_SIZE;
+}
+
+// a whole room per operation
+static long bench_map(int mask) {
+    P8map(BENCH_ROOM_X * 16, BENCH_ROOM_Y * 16, 0, 0, 16, 16, mask);
+    return 1;
+}
+
+static long bench_map_all(void) {
+    return bench_map(0);
+}
+
+static long bench_map_2(void) {
+    return bench_map(2);
+}
+
+static long bench_map_4(void) {
+    return bench_map(4);
+}
+
+static long bench_map_8(void) {
+    return bench_map(8);
+}
+
+// the copy of the window at a shaken camera to the screen, per frame
+static long bench_overscan(void) {
+    p8gfx_overscan_begin(1, -2);
+    p8gfx_overscan_end();
+    return 1;
+}
+
+// a character per operation
+static long bench_print(void) {
+    p8gfx_print(text, 0, 60, 7);
+    return sizeof text - 1;
+}
+
+// the same, a line that fits on the screen
+static long bench_print_line(void) {
+    p8gfx_print(text + 24, 2, 60, 7);
+    return sizeof text - 25;
+}
+
+// the three text boxes of the memorial message per operation
+static long bench_message(void) {
+    MESSAGE_draw(&message);
+    return 1;
+}
+
+static long bench_tile_flag_at(void) {
+    int hits = 0;
+    for (int i = 0; i < SCENE_SIZE; i++)
+        hits += tile_flag_at(queries[i].x0, queries[i].y0, 8, 8, 0);
+    sink = hits;
+    return SCENE_SIZE;
+}
+
+static long bench_spikes_at(void) {
+    int hits = 0;
+    for (int i = 0; i < SCENE_SIZE; i++)
+        hits += spikes_at(queries[i].x0 + 1, queries[i].y0 + 3, 6, 5, queries[i].x1, queries[i].y1);
+    sink = hits;
+    return SCENE_SIZE;
+}
+
+static long bench_obj_collide(void) {
+    static OBJTYPE const types[] = {OBJ_FALL_FLOOR, OBJ_PLATFORM, OBJ_BALLOON, OBJ_SPRING};
+    int hits = 0;
+    for (int i = 0; i < SCENE_SIZE; i++) {
+        player->x = queries[i].x0;
+        player->y = queries[i].y0;
+        hits += OBJ_collide(player, types[i % 4], queries[i].x1, queries[i].y1) != NULL;
+    }
+    *player = player_start;
+    sink = hits;
+    return SCENE_SIZE;
+}
+
+// from every query position, at the query speed
+static long bench_obj_move(void) {
+    int sum = 0;
+    for (int i = 0; i < SCENE_SIZE; i++) {
+        *player = player_start;
+        player->x = queries[i].x0;
+        player->y = queries[i].y0;
+        OBJ_move(player, queries[i].x1 * 0.75f, queries[i].y1 * 0.75f);
+        sum += (int)player->x + (int)player->y;
+    }
+    *player = player_start;
+    sink = sum;
+    return SCENE_SIZE;
+}
+
+// a recorded frame, played over as many bands as `pool` has threads
+static long bench_play_bands(void) {
+    bands_play(pool, &frame_list, (unsigned char *)screen);
+    return 1;
+}
+
+static long bench_present_bands(void) {
+    static uint32_t const lut[16] = {0x000000, 0x1d2b53, 0x7e2553, 0x008751, 0xab5236, 0x5f574f, 0xc2c3c7, 0xfff1e8,
+                                     0xff004d, 0xffa300, 0xffec27, 0x00e436, 0x29adff, 0x83769c, 0xff77a8, 0xffccaa};
+    int const pitch = PICO8_W * PRESENT_SCALE * sizeof *output;
+    bands_present(pool, (unsigned char *)screen, output, pitch, PRESENT_SCALE, lut);
+    return 1;
+}
+
+typedef struct {
+    char const *name;
+    long (*run)(void);
+} BENCH;
+
+static BENCH const benches[] = {
+    {"blit", bench_blit_plain},
+    {"blit_flipx", bench_blit_flipx},
+    {"blit_flipy", bench_blit_flipy},
+    {"blit_color", bench_blit_color},
+    {"blit_color_flipx", bench_blit_color_flipx},
+    {"spr_2x2", bench_spr_2x2},
+    {"rectfill", bench_rectfill},
+    {"line", bench_line},
+    {"circfill", bench_circfill},
+    {"map_all", bench_map_all},
+    {"map_2", bench_map_2},
+    {"map_4", bench_map_4},
+    {"map_8", bench_map_8},
+    {"overscan", bench_overscan},
+    {"print", bench_print},
+    {"print_line", bench_print_line},
+    {"message", bench_message},
+    {"tile_flag_at", bench_tile_flag_at},
+    {"spikes_at", bench_spikes_at},
+    {"obj_collide", bench_obj_collide},
+    {"obj_move", bench_obj_move},
+};
+
+// run with 1, 2, 4... threads up to -j
+static BENCH const band_benches[] = {
+    {"play_bands", bench_play_bands},
+    {"present_x8_bands", bench_present_bands},
+};
+
+// timing //
+////////////
+
+static void run_bench(BENCH const *b, int samples, double min_seconds) {
+    // warm up, and find how many runs take at least min_seconds
+    long runs = 1;
+    for (;;) {
+        double start = now_seconds();
+        for (long i = 0; i < runs; i++)
+            b->run();
+        if (now_seconds() - start >= min_seconds)
+            break;
+        runs *= 2;
+    }
+
+    long ops = 0;
+    double *ns = (double *)malloc(samples * sizeof *ns);
+    for (int s = 0; s < samples; s++) {
+        ops = 0;
+        double start = now_seconds();
+        for (long i = 0; i < runs; i++)
+            ops += b->run();
+        ns[s] = (now_seconds() - start) * 1e9 / ops;
+    }
+    std::sort(ns, ns + samples);
+    double median = samples % 2 ? ns[samples / 2] : (ns[samples / 2 - 1] + ns[samples / 2]) / 2;
+    printf("%s,%ld,%.3f,%.3f,%.3f\n", b->name, ops, median, ns[0], 1e3 / median);
+    fflush(stdout);
+    free(ns);
+}
+
+static void usage(char const *prog) {
+    fprintf(stderr, "usage: %s [-d data_dir] [-r samples] [-t sample_ms] [-j threads] [-f filter] [-l]\n", prog);
+    fprintf(stderr, "  -d   directory of gfx.bmp and font.bmp (default data)\n");
+    fprintf(stderr, "  -r   timed samples per benchmark (default 9)\n");
+    fprintf(stderr, "  -t   minimum length of a sample in ms (default 20)\n");
+    fprintf(stderr, "  -j   most threads of the band benchmarks (default one per core)\n");
+    fprintf(stderr, "  -f   only runs the benchmarks whose name contains the filter\n");
+    fprintf(stderr, "  -l   lists the benchmarks\n");
+}
+
+int main(int argc, char **argv) {
+    char const *data_dir = "data";
+    char const *filter = NULL;
+    int samples = 9;
+    double sample_ms = 20;
+    bool list = false;
+    int threads = (int)std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+            samples = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            sample_ms = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (!strcmp(argv[i], "-l")) {
+            list = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+    if (samples < 1 || sample_ms <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // 1, 2, 4... and `threads` itself
+    std::vector<int> counts;
+    for (int t = 1; t < threads; t *= 2)
+        counts.push_back(t);
+    counts.push_back(threads);
+
+    if (list) {
+        for (BENCH const &b : benches)
+            printf("%s\n", b.name);
+        for (BENCH const &b : band_benches)
+            for (int t : counts)
+                printf("%s_%d\n", b.name, t);
+        return 0;
+    }
+
+    if (!setup(data_dir)) {
+        fprintf(stderr, "%s: could not load the sprite sheets from '%s'\n", argv[0], data_dir);
+        return 1;
+    }
+
+    printf("name,ops,ns_per_op,min_ns_per_op,mops_per_s\n");
+    for (BENCH const &b : benches) {
+        if (!filter || strstr(b.name, filter))
+            run_bench(&b, samples, sample_ms / 1000);
+    }
+    for (BENCH const &b : band_benches) {
+        for (int t : counts) {
+            char name[64];
+            snprintf(name, sizeof name, "%s_%d", b.name, t);
+            if (filter && !strstr(name, filter))
+                continue;
+            pool = bands_create(t);
+            BENCH run = {name, b.run};
+            run_bench(&run, samples, sample_ms / 1000);
+            bands_destroy(pool);
+        }
+    }
+    return 0;
+}
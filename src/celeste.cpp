@@ -2,6 +2,10 @@
 
 #include "p8.h"
 
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#endif
+
 #ifdef __cplusplus
 #    define this xthis // this is a keyword in C++
 #endif
@@ -13,6 +17,7 @@ static void title_screen(void);
 static void load_room(int x, int y);
 static void next_room(void);
 static void psfx(int num);
+static void play_music(int track, int fade, int mask);
 static void restart_room(void);
 
 static float clamp(float val, float a, float b);
@@ -24,6 +29,7 @@ static bool ice_at(int x, int y, int w, int h);
 static bool tile_flag_at(int x, int y, int w, int h, int flag);
 static int tile_at(int x, int y);
 static bool spikes_at(float x, float y, int w, int h, float xspd, float yspd);
+static void build_collision_boards(void);
 
 #define MAX_OBJECTS 30
 #define FRUIT_COUNT 30
@@ -44,28 +50,6 @@ typedef struct {
     int x, y;
 } VECI;
 
-static VECI room = {.x = 0, .y = 0};
-// static int num_objects = 0;
-static int freeze = 0;
-static int shake = 0;
-static bool will_restart = false;
-static int delay_restart = 0;
-static bool got_fruit[FRUIT_COUNT] = {};
-static bool has_dashed = false;
-static int sfx_timer = 0;
-static bool has_key = false;
-static bool pause_player = false;
-static bool flash_bg = false;
-static int music_timer = 0;
-
-// these are originally implicit globals defined in title_screen()
-static bool new_bg = false;
-static int frames, seconds;
-static short minutes; // this variable can overflow in normal gameplay (after +500 hours)
-static int deaths, max_djump;
-static bool start_game;
-static int start_game_flash;
-
 enum {
     k_left = 0,
     k_right = 1,
@@ -105,6 +89,163 @@ typedef enum {
         OBJTYPE_COUNT
 } OBJTYPE;
 
+typedef struct {
+    float x, y, spd, w;
+} CLOUD;
+
+typedef struct {
+    bool active;
+    float x, y, s, spd, off, c, h, t;
+    VEC spd2; // used by dead particles, moved from spd
+} PARTICLE;
+
+typedef struct {
+    int x, y, w, h;
+} HITBOX;
+
+typedef struct {
+    float x, y, size;
+    bool isLast;
+} HAIR;
+
+// OBJECT strucutre
+typedef struct {
+    // hot: everything the collision scans and movement code touch comes
+    // first, so that walking objects[] only reads the head of each slot
+    bool active;
+    bool collideable, solids;
+    short id;
+    OBJTYPE type;
+    float x, y;
+    HITBOX hitbox;
+    VEC spd;
+    VEC rem;
+
+    // inherited
+    float spr;
+    bool flip_x, flip_y;
+
+    // used by several types
+    int state, delay, timer;
+    float start;
+
+    // cold: the fields of the other types share storage
+    union {
+        struct {
+            bool p_jump, p_dash;
+            int grace, jbuffer, djump, dash_time;
+            short dash_effect_time; // can underflow in normal gameplay (after 18 minutes)
+            VEC dash_target;
+            VEC dash_accel;
+            float spr_off;
+            bool was_on_ground;
+            HAIR hair[5]; // also player_spawn
+            VEC target;   // player_spawn
+        } player;
+
+        struct {
+            int hide_in, hide_for;
+        } spring;
+
+        struct {
+            float offset;
+        } balloon;
+
+        struct {
+            float off;
+        } fruit;
+
+        struct {
+            bool fly;
+            float step;
+            int sfx_delay;
+        } fly_fruit;
+
+        struct {
+            int duration;
+            float flash;
+        } lifeup;
+
+        struct {
+            float last, dir;
+        } platform;
+
+        struct {
+            char const *text;
+            float index, last;
+            VECI off2; // changed from off..
+        } message;
+
+        struct {
+            int score;
+            bool show;
+        } flag;
+    };
+} OBJ;
+
+// the big chest is the only object with particles of its own, and there is
+// never more than one of them, so they live in GAME_STATE rather than in
+// every OBJ
+typedef struct {
+    float x, y, spd, h;
+} CHEST_PARTICLE;
+
+// all of the state the game mutates lives in a GAME_STATE, one per
+// CelesteContext. instances do not share anything mutable and a savestate is
+// a single copy (see Celeste_P8_save_state)
+typedef struct {
+    VECI room;
+    int freeze;
+    int shake;
+    bool will_restart;
+    int delay_restart;
+    bool got_fruit[FRUIT_COUNT];
+    bool has_dashed;
+    int sfx_timer;
+    bool has_key;
+    bool pause_player;
+    bool flash_bg;
+    int music_timer;
+    int music; // last track passed to play_music(), -1 when stopped
+
+    // these are originally implicit globals defined in title_screen()
+    bool new_bg;
+    int frames, seconds;
+    short minutes; // this variable can overflow in normal gameplay (after +500 hours)
+    int deaths, max_djump;
+    bool start_game;
+    int start_game_flash;
+
+    // collision bitboards of the current room, built by load_room(). bit i of
+    // row j is set when tile (i,j) has the tile flag, or is that kind of spikes
+    unsigned short flag_board[8][16];
+    unsigned short spikes_board[4][16]; // tiles 17, 27, 43 and 59
+
+    CLOUD clouds[17];
+    PARTICLE particles[25];
+    PARTICLE dead_particles[8];
+    CHEST_PARTICLE chest_particles[50];
+    int chest_particle_count;
+
+    OBJ objects[MAX_OBJECTS];
+    OBJ player_dummy_copy; // see PLAYER_update()
+    short next_id;
+    bool room_just_loaded; // for debugging loading jank
+} GAME_STATE;
+
+struct CelesteContext {
+    GAME_STATE game;
+    P8STATE p8;
+};
+
+// the instance being run on the calling thread, set by every entry point
+static thread_local GAME_STATE *G = NULL;
+
+static void bind(CelesteContext *ctx) {
+    G = &ctx->game;
+    P8 = &ctx->p8;
+}
+
 // entry point //
 /////////////////
 
@@ -114,7 +255,26 @@ static void PRELUDE() {
     PRELUDE_initparticles();
 }
 
-void Celeste_P8_init() { // identifiers beginning with underscores are reserved in C
+CelesteContext *Celeste_P8_create(void) {
+    CelesteContext *ctx = (CelesteContext *)calloc(1, sizeof *ctx);
+    if (ctx) {
+        ctx->game.music = -1;
+        ctx->p8.rnd_seed_hi = 1;
+    }
+    return ctx;
+}
+
+void Celeste_P8_destroy(CelesteContext *ctx) {
+    free(ctx);
+}
+
+void Celeste_P8_set_rndseed(CelesteContext *ctx, unsigned seed) {
+    bind(ctx);
+    P8srand(seed);
+}
+
+void Celeste_P8_init(CelesteContext *ctx) { // identifiers beginning with underscores are reserved in C
+    bind(ctx);
     PRELUDE();
 
     title_screen();
@@ -122,29 +282,29 @@ void Celeste_P8_init() { // identifiers beginning with underscores are reserved
 
 static void title_screen() {
     for (int i = 0; i <= 29; i++)
-        got_fruit[i] = false;
-    frames = 0;
-    deaths = 0;
-    max_djump = 1;
-    start_game = false;
-    start_game_flash = 0;
-    P8music(40, 0, 7);
+        G->got_fruit[i] = false;
+    G->frames = 0;
+    G->deaths = 0;
+    G->max_djump = 1;
+    G->start_game = false;
+    G->start_game_flash = 0;
+    play_music(40, 0, 7);
 
     load_room(7, 3);
 }
 
 static void begin_game() {
-    frames = 0;
-    seconds = 0;
-    minutes = 0;
-    music_timer = 0;
-    start_game = false;
-    P8music(0, 0, 7);
+    G->frames = 0;
+    G->seconds = 0;
+    G->minutes = 0;
+    G->music_timer = 0;
+    G->start_game = false;
+    play_music(0, 0, 7);
     load_room(0, 0);
 }
 
 static int level_index() {
-    return room.x % 8 + room.y * 8;
+    return G->room.x % 8 + G->room.y * 8;
 }
 
 static bool is_title() {
@@ -154,14 +314,10 @@ static bool is_title() {
 // effects //
 /////////////
 
-typedef struct {
-    float x, y, spd, w;
-} CLOUD;
-static CLOUD clouds[17];
 // top level init code has been moved into a function
 static void PRELUDE_initclouds() {
     for (int i = 0; i <= 16; i++) {
-        clouds[i] = (CLOUD){
+        G->clouds[i] = (CLOUD){
             .x = P8rnd(128),
             .y = P8rnd(128),
             .spd = 1 + P8rnd(4),
@@ -170,18 +326,11 @@ static void PRELUDE_initclouds() {
     }
 }
 
-typedef struct {
-    bool active;
-    float x, y, s, spd, off, c, h, t;
-    VEC spd2; // used by dead particles, moved from spd
-} PARTICLE;
-static PARTICLE particles[25];
-static PARTICLE dead_particles[8];
 
 // top level init code has been moved into a function
 static void PRELUDE_initparticles() {
     for (int i = 0; i <= 24; i++) {
-        particles[i] = (PARTICLE){
+        G->particles[i] = (PARTICLE){
             .x = P8rnd(128),
             .y = P8rnd(128),
             .s = 0 + P8flr(P8rnd(5) / 4),
@@ -192,80 +341,6 @@ static void PRELUDE_initparticles() {
     }
 }
 
-typedef struct {
-    int x, y, w, h;
-} HITBOX;
-
-typedef struct {
-    float x, y, size;
-    bool isLast;
-} HAIR;
-
-// OBJECT strucutre
-typedef struct {
-    bool active;
-    short id;
-
-    // inherited
-    OBJTYPE type;
-    bool collideable, solids;
-    float spr;
-    bool flip_x, flip_y;
-    float x, y;
-    HITBOX hitbox;
-    VEC spd;
-    VEC rem;
-
-    // player
-    bool p_jump, p_dash;
-    int grace, jbuffer, djump, dash_time;
-    short dash_effect_time; // can underflow in normal gameplay (after 18 minutes)
-    VEC dash_target;
-    VEC dash_accel;
-    float spr_off;
-    bool was_on_ground;
-    HAIR hair[5]; // also player_spawn
-
-    // player_spawn
-    int state, delay;
-    VEC target;
-
-    // spring
-    int hide_in, hide_for;
-
-    // balloon
-    int timer;
-    float offset, start;
-
-    // fruit
-    float off;
-
-    // fly_fruit
-    bool fly;
-    float step;
-    int sfx_delay;
-
-    // lifeup
-    int duration;
-    float flash;
-
-    // platform
-    float last, dir;
-
-    // message
-    char const *text;
-    float index;
-    VECI off2; // changed from off..
-
-    // big chest
-    PARTICLE particles[50];
-    int particle_count;
-
-    // flag
-    int score;
-    bool show;
-} OBJ;
-
 // OBJ function declarations fuckery
 #define when_Y(x) static void x(OBJ *this);
 #define when_N(x) enum { x = 0 }; // OBJTYPE_prop definition requires a constant value, and `static cost void* x = NULL` doesn't count
@@ -304,8 +379,6 @@ static const struct objprop OBJTYPE_prop[] = {
 
 #define OBJ_PROP(o) OBJTYPE_prop[(o)->type]
 
-static OBJ objects[MAX_OBJECTS] = {{.active = false}};
-
 static void create_hair(OBJ *obj);
 static void set_hair_color(int c);
 static void draw_hair(OBJ *obj, int facing);
@@ -327,11 +400,59 @@ static void OBJ_move(OBJ *obj, float ox, float oy);
 static void OBJ_move_x(OBJ *obj, float amount, float start);
 static void OBJ_move_y(OBJ *obj, float amount);
 
-static bool OBJ_is_solid(OBJ *obj, float ox, float oy) {
-    if (oy > 0 && !OBJ_check(obj, OBJ_PLATFORM, ox, 0) && OBJ_check(obj, OBJ_PLATFORM, ox, oy)) {
+// the objects OBJ_is_solid() tests against, gathered in a single pass over
+// objects[]. moving an object does not change any of them, so a move can
+// gather them once and then test every step of the sweep against this list
+typedef struct {
+    OBJ *walls[MAX_OBJECTS]; // fall floors and fake walls
+    OBJ *platforms[MAX_OBJECTS];
+    int wall_count, platform_count;
+} SOLIDS;
+
+static void gather_solids(OBJ *obj, SOLIDS *solids) {
+    solids->wall_count = solids->platform_count = 0;
+    for (int i = 0; i < MAX_OBJECTS; i++) {
+        OBJ *other = &G->objects[i];
+        if (!other->active || other == obj || !other->collideable)
+            continue;
+        if (other->type == OBJ_FALL_FLOOR || other->type == OBJ_FAKE_WALL) {
+            solids->walls[solids->wall_count++] = other;
+        } else if (other->type == OBJ_PLATFORM) {
+            solids->platforms[solids->platform_count++] = other;
+        }
+    }
+}
+
+// OBJ_collide()'s overlap test, with obj at (x, y)
+static bool overlaps_at(OBJ *obj, float x, float y, OBJ *other, float ox, float oy) {
+    return other->x + other->hitbox.x + other->hitbox.w > x + obj->hitbox.x + ox &&
+           other->y + other->hitbox.y + other->hitbox.h > y + obj->hitbox.y + oy &&
+           other->x + other->hitbox.x < x + obj->hitbox.x + obj->hitbox.w + ox &&
+           other->y + other->hitbox.y < y + obj->hitbox.y + obj->hitbox.h + oy;
+}
+
+static bool overlaps_any(OBJ *obj, float x, float y, OBJ *const *others, int count, float ox, float oy) {
+    for (int i = 0; i < count; i++) {
+        if (overlaps_at(obj, x, y, others[i], ox, oy))
+            return true;
+    }
+    return false;
+}
+
+// OBJ_is_solid(), with obj at (x, y)
+static bool solid_at_pos(OBJ *obj, SOLIDS const *solids, float x, float y, float ox, float oy) {
+    if (oy > 0 && !overlaps_any(obj, x, y, solids->platforms, solids->platform_count, ox, 0) &&
+        overlaps_any(obj, x, y, solids->platforms, solids->platform_count, ox, oy)) {
         return true;
     }
-    return solid_at(obj->x + obj->hitbox.x + ox, obj->y + obj->hitbox.y + oy, obj->hitbox.w, obj->hitbox.h) || OBJ_check(obj, OBJ_FALL_FLOOR, ox, oy) || OBJ_check(obj, OBJ_FAKE_WALL, ox, oy);
+    return solid_at(x + obj->hitbox.x + ox, y + obj->hitbox.y + oy, obj->hitbox.w, obj->hitbox.h) ||
+           overlaps_any(obj, x, y, solids->walls, solids->wall_count, ox, oy);
+}
+
+static bool OBJ_is_solid(OBJ *obj, float ox, float oy) {
+    SOLIDS solids;
+    gather_solids(obj, &solids);
+    return solid_at_pos(obj, &solids, obj->x, obj->y, ox, oy);
 }
 
 static bool OBJ_is_ice(OBJ *obj, float ox, float oy) {
@@ -341,7 +462,7 @@ static bool OBJ_is_ice(OBJ *obj, float ox, float oy) {
 static OBJ *OBJ_collide(OBJ *obj, OBJTYPE type, float ox, float oy) {
     OBJ *other;
     for (int i = 0; i < MAX_OBJECTS; i++) {
-        other = &objects[i];
+        other = &G->objects[i];
         if (other->active && other->type == type && other != obj && other->collideable &&
             other->x + other->hitbox.x + other->hitbox.w > obj->x + obj->hitbox.x + ox &&
             other->y + other->hitbox.y + other->hitbox.h > obj->y + obj->hitbox.y + oy &&
@@ -372,18 +493,25 @@ static void OBJ_move(OBJ *obj, float ox, float oy) {
     OBJ_move_y(obj, amount);
 }
 
+// the movers sweep the hitbox one pixel at a time until the first blocked
+// position, exactly like stepping with OBJ_is_solid() would, but against
+// the room bitboards and a pre-gathered list of solid objects
 static void OBJ_move_x(OBJ *obj, float amount, float start) {
     if (obj->solids) {
+        SOLIDS solids;
+        gather_solids(obj, &solids);
         float step = sign(amount);
+        float x = obj->x;
         for (float i = start; i <= P8abs(amount); i += 1) {
-            if (!OBJ_is_solid(obj, step, 0)) {
-                obj->x += step;
+            if (!solid_at_pos(obj, &solids, x, obj->y, step, 0)) {
+                x += step;
             } else {
                 obj->spd.x = 0;
                 obj->rem.x = 0;
                 break;
             }
         }
+        obj->x = x;
     } else {
         obj->x += amount;
     }
@@ -391,16 +519,20 @@ static void OBJ_move_x(OBJ *obj, float amount, float start) {
 
 static void OBJ_move_y(OBJ *obj, float amount) {
     if (obj->solids) {
+        SOLIDS solids;
+        gather_solids(obj, &solids);
         float step = sign(amount);
+        float y = obj->y;
         for (int i = 0; i <= P8abs(amount); i++) {
-            if (!OBJ_is_solid(obj, 0, step)) {
-                obj->y += step;
+            if (!solid_at_pos(obj, &solids, obj->x, y, 0, step)) {
+                y += step;
             } else {
                 obj->spd.y = 0;
                 obj->rem.y = 0;
                 break;
             }
         }
+        obj->y = y;
     } else {
         obj->y += amount;
     }
@@ -410,24 +542,23 @@ static void OBJ_move_y(OBJ *obj, float amount) {
 ///////////////////
 
 static void PLAYER_init(OBJ *this) {
-    this->p_jump = false;
-    this->p_dash = false;
-    this->grace = 0;
-    this->jbuffer = 0;
-    this->djump = max_djump;
-    this->dash_time = 0;
-    this->dash_effect_time = 0;
-    this->dash_target = (VEC){.x = 0, .y = 0};
-    this->dash_accel = (VEC){.x = 0, .y = 0};
+    this->player.p_jump = false;
+    this->player.p_dash = false;
+    this->player.grace = 0;
+    this->player.jbuffer = 0;
+    this->player.djump = G->max_djump;
+    this->player.dash_time = 0;
+    this->player.dash_effect_time = 0;
+    this->player.dash_target = (VEC){.x = 0, .y = 0};
+    this->player.dash_accel = (VEC){.x = 0, .y = 0};
     this->hitbox = (HITBOX){.x = 1, .y = 3, .w = 6, .h = 5};
-    this->spr_off = 0;
-    this->was_on_ground = false;
+    this->player.spr_off = 0;
+    this->player.was_on_ground = false;
     create_hair(this);
 }
 
-static OBJ player_dummy_copy; // see below
 static void PLAYER_update(OBJ *this) {
-    if (pause_player)
+    if (G->pause_player)
         return;
 
     int input = P8btn(k_right) ? 1 : (P8btn(k_left) ? -1 : 0);
@@ -450,46 +581,46 @@ static void PLAYER_update(OBJ *this) {
     }
     if (do_kill_player) {
         // switch to dummy copy, need to copy before destroying the object
-        player_dummy_copy = *this;
+        G->player_dummy_copy = *this;
         kill_player(this);
-        this = &player_dummy_copy;
+        this = &G->player_dummy_copy;
     }
 
     bool on_ground = OBJ_is_solid(this, 0, 1);
     bool on_ice = OBJ_is_ice(this, 0, 1);
 
     // smoke particles
-    if (on_ground && !this->was_on_ground) {
+    if (on_ground && !this->player.was_on_ground) {
         init_object(OBJ_SMOKE, this->x, this->y + 4);
     }
 
-    bool jump = P8btn(k_jump) && !this->p_jump;
-    this->p_jump = P8btn(k_jump);
+    bool jump = P8btn(k_jump) && !this->player.p_jump;
+    this->player.p_jump = P8btn(k_jump);
     if ((jump)) {
-        this->jbuffer = 4;
-    } else if (this->jbuffer > 0) {
-        this->jbuffer -= 1;
+        this->player.jbuffer = 4;
+    } else if (this->player.jbuffer > 0) {
+        this->player.jbuffer -= 1;
     }
 
-    bool dash = P8btn(k_dash) && !this->p_dash;
-    this->p_dash = P8btn(k_dash);
+    bool dash = P8btn(k_dash) && !this->player.p_dash;
+    this->player.p_dash = P8btn(k_dash);
 
     if (on_ground) {
-        this->grace = 6;
-        if (this->djump < max_djump) {
+        this->player.grace = 6;
+        if (this->player.djump < G->max_djump) {
             psfx(54);
-            this->djump = max_djump;
+            this->player.djump = G->max_djump;
         }
-    } else if (this->grace > 0) {
-        this->grace -= 1;
+    } else if (this->player.grace > 0) {
+        this->player.grace -= 1;
     }
 
-    this->dash_effect_time -= 1;
-    if (this->dash_time > 0) {
+    this->player.dash_effect_time -= 1;
+    if (this->player.dash_time > 0) {
         init_object(OBJ_SMOKE, this->x, this->y);
-        this->dash_time -= 1;
-        this->spd.x = appr(this->spd.x, this->dash_target.x, this->dash_accel.x);
-        this->spd.y = appr(this->spd.y, this->dash_target.y, this->dash_accel.y);
+        this->player.dash_time -= 1;
+        this->spd.x = appr(this->spd.x, this->player.dash_target.x, this->player.dash_accel.x);
+        this->spd.y = appr(this->spd.y, this->player.dash_target.y, this->player.dash_accel.y);
     } else {
 
         // move
@@ -538,12 +669,12 @@ static void PLAYER_update(OBJ *this) {
         }
 
         // jump
-        if (this->jbuffer > 0) {
-            if (this->grace > 0) {
+        if (this->player.jbuffer > 0) {
+            if (this->player.grace > 0) {
                 // normal jump
                 psfx(1);
-                this->jbuffer = 0;
-                this->grace = 0;
+                this->player.jbuffer = 0;
+                this->player.grace = 0;
                 this->spd.y = -2;
                 init_object(OBJ_SMOKE, this->x, this->y + 4);
             } else {
@@ -551,7 +682,7 @@ static void PLAYER_update(OBJ *this) {
                 int wall_dir = (OBJ_is_solid(this, -3, 0) ? -1 : (OBJ_is_solid(this, 3, 0) ? 1 : 0));
                 if (wall_dir != 0) {
                     psfx(2);
-                    this->jbuffer = 0;
+                    this->player.jbuffer = 0;
                     this->spd.y = -2;
                     this->spd.x = -wall_dir * (maxrun + 1);
                     if (!OBJ_is_ice(this, wall_dir * 3, 0)) {
@@ -565,12 +696,12 @@ static void PLAYER_update(OBJ *this) {
         float d_full = 5;
         float d_half = d_full * 0.70710678118;
 
-        if (this->djump > 0 && dash) {
+        if (this->player.djump > 0 && dash) {
             init_object(OBJ_SMOKE, this->x, this->y);
-            this->djump -= 1;
-            this->dash_time = 4;
-            has_dashed = true;
-            this->dash_effect_time = 10;
+            this->player.djump -= 1;
+            this->player.dash_time = 4;
+            G->has_dashed = true;
+            this->player.dash_effect_time = 10;
             int v_input = (P8btn(k_up) ? -1 : (P8btn(k_down) ? 1 : 0));
             if (input != 0) {
                 if (v_input != 0) {
@@ -589,31 +720,31 @@ static void PLAYER_update(OBJ *this) {
             }
 
             psfx(3);
-            freeze = 2;
-            shake = 6;
-            this->dash_target.x = 2 * sign(this->spd.x);
-            this->dash_target.y = 2 * sign(this->spd.y);
-            this->dash_accel.x = 1.5;
-            this->dash_accel.y = 1.5;
+            G->freeze = 2;
+            G->shake = 6;
+            this->player.dash_target.x = 2 * sign(this->spd.x);
+            this->player.dash_target.y = 2 * sign(this->spd.y);
+            this->player.dash_accel.x = 1.5;
+            this->player.dash_accel.y = 1.5;
 
             if (this->spd.y < 0) {
-                this->dash_target.y *= .75;
+                this->player.dash_target.y *= .75;
             }
 
             if (this->spd.y != 0) {
-                this->dash_accel.x *= 0.70710678118f;
+                this->player.dash_accel.x *= 0.70710678118f;
             }
             if (this->spd.x != 0) {
-                this->dash_accel.y *= 0.70710678118f;
+                this->player.dash_accel.y *= 0.70710678118f;
             }
-        } else if (dash && this->djump <= 0) {
+        } else if (dash && this->player.djump <= 0) {
             psfx(9);
             init_object(OBJ_SMOKE, this->x, this->y);
         }
     }
 
     // animation
-    this->spr_off += 0.25;
+    this->player.spr_off += 0.25;
     if (!on_ground) {
         if (OBJ_is_solid(this, input, 0)) {
             this->spr = 5;
@@ -627,7 +758,7 @@ static void PLAYER_update(OBJ *this) {
     } else if ((this->spd.x == 0) || (!P8btn(k_left) && !P8btn(k_right))) {
         this->spr = 1;
     } else {
-        this->spr = 1 + ((int)this->spr_off) % 4;
+        this->spr = 1 + ((int)this->player.spr_off) % 4;
     }
 
     // next level
@@ -636,7 +767,7 @@ static void PLAYER_update(OBJ *this) {
     }
 
     // was on the ground
-    this->was_on_ground = on_ground;
+    this->player.was_on_ground = on_ground;
 }
 static void PLAYER_draw(OBJ *this) {
     // clamp in screen
@@ -645,22 +776,28 @@ static void PLAYER_draw(OBJ *this) {
         this->spd.x = 0;
     }
 
-    set_hair_color(this->djump);
+    set_hair_color(this->player.djump);
     draw_hair(this, this->flip_x ? -1 : 1);
     P8spr(this->spr, this->x, this->y, 1, 1, this->flip_x, this->flip_y);
     unset_hair_color();
 }
 
 static void psfx(int num) {
-    if (sfx_timer <= 0) {
+    if (G->sfx_timer <= 0) {
         P8sfx(num);
     }
 }
 
+// remembers the track so that loading a savestate can switch back to it
+static void play_music(int track, int fade, int mask) {
+    G->music = track;
+    P8music(track, fade, mask);
+}
+
 void create_hair(OBJ *obj) {
-    /*obj->hair = {};*/
+    /*obj->player.hair = {};*/
     for (int i = 0; i <= 4; i++) {
-        obj->hair[i] = (HAIR){
+        obj->player.hair[i] = (HAIR){
             .x = obj->x,
             .y = obj->y,
             .size = P8max(1, P8min(2, 3 - i)),
@@ -670,7 +807,7 @@ void create_hair(OBJ *obj) {
 }
 
 static void set_hair_color(int djump) {
-    P8pal(8, (djump == 1 ? 8 : (djump == 2 ? (7 + P8flr(((int)(((float)frames) / 3.0)) % 2) * 4) : 12)));
+    P8pal(8, (djump == 1 ? 8 : (djump == 2 ? (7 + P8flr(((int)(((float)G->frames) / 3.0)) % 2) * 4) : 12)));
 }
 
 static void draw_hair(OBJ *obj, int facing) {
@@ -679,7 +816,7 @@ static void draw_hair(OBJ *obj, int facing) {
     HAIR *h;
     int i = 0;
     do {
-        h = &obj->hair[i++];
+        h = &obj->player.hair[i++];
         h->x += (last_x - h->x) / 1.5;
         h->y += (last_y + 0.5 - h->y) / 1.5;
         P8circfill(h->x, h->y, h->size, 8);
@@ -696,8 +833,8 @@ static void unset_hair_color() {
 static void PLAYER_SPAWN_init(OBJ *this) {
     P8sfx(4);
     this->spr = 3;
-    this->target.x = this->x;
-    this->target.y = this->y;
+    this->player.target.x = this->x;
+    this->player.target.y = this->y;
     this->y = 128;
     this->spd.y = -4;
     this->state = 0;
@@ -708,7 +845,7 @@ static void PLAYER_SPAWN_init(OBJ *this) {
 static void PLAYER_SPAWN_update(OBJ *this) {
     // jumping up
     if (this->state == 0) {
-        if (this->y < this->target.y + 16) {
+        if (this->y < this->player.target.y + 16) {
             this->state = 1;
             this->delay = 3;
         }
@@ -719,12 +856,12 @@ static void PLAYER_SPAWN_update(OBJ *this) {
             this->spd.y = 0;
             this->delay -= 1;
         }
-        if (this->spd.y > 0 && this->y > this->target.y) {
-            this->y = this->target.y;
+        if (this->spd.y > 0 && this->y > this->player.target.y) {
+            this->y = this->player.target.y;
             this->spd.x = this->spd.y = 0;
             this->state = 2;
             this->delay = 5;
-            shake = 5;
+            G->shake = 5;
             init_object(OBJ_SMOKE, this->x, this->y + 4);
             P8sfx(5);
         }
@@ -740,7 +877,7 @@ static void PLAYER_SPAWN_update(OBJ *this) {
     }
 }
 static void PLAYER_SPAWN_draw(OBJ *this) {
-    set_hair_color(max_djump);
+    set_hair_color(G->max_djump);
     draw_hair(this, 1);
     P8spr(this->spr, this->x, this->y, 1, 1, this->flip_x, this->flip_y);
     unset_hair_color();
@@ -748,13 +885,13 @@ static void PLAYER_SPAWN_draw(OBJ *this) {
 
 // spring
 static void SPRING_init(OBJ *this) {
-    this->hide_in = 0;
-    this->hide_for = 0;
+    this->spring.hide_in = 0;
+    this->spring.hide_for = 0;
 }
 static void SPRING_update(OBJ *this) {
-    if (this->hide_for > 0) {
-        this->hide_for -= 1;
-        if (this->hide_for <= 0) {
+    if (this->spring.hide_for > 0) {
+        this->spring.hide_for -= 1;
+        if (this->spring.hide_for <= 0) {
             this->spr = 18;
             this->delay = 0;
         }
@@ -765,7 +902,7 @@ static void SPRING_update(OBJ *this) {
             hit->y = this->y - 4;
             hit->spd.x *= 0.2;
             hit->spd.y = -3;
-            hit->djump = max_djump;
+            hit->player.djump = G->max_djump;
             this->delay = 10;
             init_object(OBJ_SMOKE, this->x, this->y);
 
@@ -784,35 +921,35 @@ static void SPRING_update(OBJ *this) {
         }
     }
     // begin hiding
-    if (this->hide_in > 0) {
-        this->hide_in -= 1;
-        if (this->hide_in <= 0) {
-            this->hide_for = 60;
+    if (this->spring.hide_in > 0) {
+        this->spring.hide_in -= 1;
+        if (this->spring.hide_in <= 0) {
+            this->spring.hide_for = 60;
             this->spr = 0;
         }
     }
 }
 
 static void break_spring(OBJ *obj) {
-    obj->hide_in = 15;
+    obj->spring.hide_in = 15;
 }
 
 // balloon
 static void BALLOON_init(OBJ *this) {
-    this->offset = P8rnd(1);
+    this->balloon.offset = P8rnd(1);
     this->start = this->y;
     this->timer = 0;
     this->hitbox = (HITBOX){.x = -1, .y = -1, .w = 10, .h = 10};
 }
 static void BALLOON_update(OBJ *this) {
     if (this->spr == 22) {
-        this->offset += 0.01;
-        this->y = this->start + P8sin(this->offset) * 2;
+        this->balloon.offset += 0.01;
+        this->y = this->start + P8sin(this->balloon.offset) * 2;
         OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 0);
-        if (hit != NULL && hit->djump < max_djump) {
+        if (hit != NULL && hit->player.djump < G->max_djump) {
             psfx(6);
             init_object(OBJ_SMOKE, this->x, this->y);
-            hit->djump = max_djump;
+            hit->player.djump = G->max_djump;
             this->spr = 0;
             this->timer = 60;
         }
@@ -826,7 +963,7 @@ static void BALLOON_update(OBJ *this) {
 }
 static void BALLOON_draw(OBJ *this) {
     if (this->spr == 22) {
-        P8spr(13 + (int)(this->offset * 8) % 3, this->x, this->y + 6, 1, 1, false, false);
+        P8spr(13 + (int)(this->balloon.offset * 8) % 3, this->x, this->y + 6, 1, 1, false, false);
         P8spr(this->spr, this->x, this->y, 1, 1, false, false);
     }
 }
@@ -907,21 +1044,21 @@ static void SMOKE_update(OBJ *this) {
 // if_not_fruit=true,
 static void FRUIT_init(OBJ *this) {
     this->start = this->y;
-    this->off = 0;
+    this->fruit.off = 0;
 }
 static void FRUIT_update(OBJ *this) {
     OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 0);
     if (hit != NULL) {
-        hit->djump = max_djump;
-        sfx_timer = 20;
+        hit->player.djump = G->max_djump;
+        G->sfx_timer = 20;
         P8sfx(13);
-        got_fruit[level_index()] = true;
+        G->got_fruit[level_index()] = true;
         init_object(OBJ_LIFEUP, this->x, this->y);
         destroy_object(this);
         return; // LEMON: added return to not modify dead object
     }
-    this->off += 1;
-    this->y = this->start + P8sin(this->off / 40) * 2.5f;
+    this->fruit.off += 1;
+    this->y = this->start + P8sin(this->fruit.off / 40) * 2.5f;
 }
 
 // fly_fruit
@@ -929,19 +1066,19 @@ static void FRUIT_update(OBJ *this) {
 // if_not_fruit=true,
 static void FLY_FRUIT_init(OBJ *this) {
     this->start = this->y;
-    this->fly = false;
-    this->step = 0.5;
+    this->fly_fruit.fly = false;
+    this->fly_fruit.step = 0.5;
     this->solids = false;
-    this->sfx_delay = 8;
+    this->fly_fruit.sfx_delay = 8;
 }
 static void FLY_FRUIT_update(OBJ *this) {
     bool do_destroy_object = false; // LEMON: see PLAYER_update..
     // fly away
-    if (this->fly) {
-        if (this->sfx_delay > 0) {
-            this->sfx_delay -= 1;
-            if (this->sfx_delay <= 0) {
-                sfx_timer = 20;
+    if (this->fly_fruit.fly) {
+        if (this->fly_fruit.sfx_delay > 0) {
+            this->fly_fruit.sfx_delay -= 1;
+            if (this->fly_fruit.sfx_delay <= 0) {
+                G->sfx_timer = 20;
                 P8sfx(14);
             }
         }
@@ -951,19 +1088,19 @@ static void FLY_FRUIT_update(OBJ *this) {
         }
         // wait
     } else {
-        if (has_dashed) {
-            this->fly = true;
+        if (G->has_dashed) {
+            this->fly_fruit.fly = true;
         }
-        this->step += 0.05;
-        this->spd.y = P8sin(this->step) * 0.5;
+        this->fly_fruit.step += 0.05;
+        this->spd.y = P8sin(this->fly_fruit.step) * 0.5;
     }
     // collect
     OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 0);
     if (hit != NULL) {
-        hit->djump = max_djump;
-        sfx_timer = 20;
+        hit->player.djump = G->max_djump;
+        G->sfx_timer = 20;
         P8sfx(13);
-        got_fruit[level_index()] = true;
+        G->got_fruit[level_index()] = true;
         init_object(OBJ_LIFEUP, this->x, this->y);
         do_destroy_object = true;
     }
@@ -972,8 +1109,8 @@ static void FLY_FRUIT_update(OBJ *this) {
 }
 static void FLY_FRUIT_draw(OBJ *this) {
     float off = 0;
-    if (!this->fly) {
-        float dir = P8sin(this->step);
+    if (!this->fly_fruit.fly) {
+        float dir = P8sin(this->fly_fruit.step);
         if (dir < 0) {
             off = 1 + P8max(0, sign(this->y - this->start));
         }
@@ -988,22 +1125,22 @@ static void FLY_FRUIT_draw(OBJ *this) {
 // lifeup
 static void LIFEUP_init(OBJ *this) {
     this->spd.y = -0.25;
-    this->duration = 30;
+    this->lifeup.duration = 30;
     this->x -= 2;
     this->y -= 4;
-    this->flash = 0;
+    this->lifeup.flash = 0;
     this->solids = false;
 }
 static void LIFEUP_update(OBJ *this) {
-    this->duration -= 1;
-    if (this->duration <= 0) {
+    this->lifeup.duration -= 1;
+    if (this->lifeup.duration <= 0) {
         destroy_object(this);
     }
 }
 static void LIFEUP_draw(OBJ *this) {
-    this->flash += 0.5;
+    this->lifeup.flash += 0.5;
 
-    P8print("1000", this->x - 2, this->y, 7 + ((int)this->flash) % 2);
+    P8print("1000", this->x - 2, this->y, 7 + ((int)this->lifeup.flash) % 2);
 }
 
 // fake_wall
@@ -1012,11 +1149,11 @@ static void LIFEUP_draw(OBJ *this) {
 static void FAKE_WALL_update(OBJ *this) {
     this->hitbox = (HITBOX){.x = -1, .y = -1, .w = 18, .h = 18};
     OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 0);
-    if (hit != NULL && hit->dash_effect_time > 0) {
+    if (hit != NULL && hit->player.dash_effect_time > 0) {
         hit->spd.x = -sign(hit->spd.x) * 1.5;
         hit->spd.y = -1.5;
-        hit->dash_time = -1;
-        sfx_timer = 20;
+        hit->player.dash_time = -1;
+        G->sfx_timer = 20;
         P8sfx(16);
         // destroy_object(this);
         init_object(OBJ_SMOKE, this->x, this->y);
@@ -1030,10 +1167,7 @@ static void FAKE_WALL_update(OBJ *this) {
     this->hitbox = (HITBOX){.x = 0, .y = 0, .w = 16, .h = 16};
 }
 static void FAKE_WALL_draw(OBJ *this) {
-    P8spr(64, this->x, this->y, 1, 1, false, false);
-    P8spr(65, this->x + 8, this->y, 1, 1, false, false);
-    P8spr(80, this->x, this->y + 8, 1, 1, false, false);
-    P8spr(81, this->x + 8, this->y + 8, 1, 1, false, false);
+    P8spr(64, this->x, this->y, 2, 2, false, false);
 }
 
 // key
@@ -1041,16 +1175,16 @@ static void FAKE_WALL_draw(OBJ *this) {
 // if_not_fruit=true,
 static void KEY_update(OBJ *this) {
     int was = P8flr(this->spr);
-    this->spr = 9 + (P8sin((float)frames / 30.0) + 0.5) * 1;
+    this->spr = 9 + (P8sin((float)G->frames / 30.0) + 0.5) * 1;
     int is = P8flr(this->spr);
     if (is == 10 && is != was) {
         this->flip_x = !this->flip_x;
     }
     if (OBJ_check(this, OBJ_PLAYER, 0, 0)) {
         P8sfx(23);
-        sfx_timer = 10;
+        G->sfx_timer = 10;
         destroy_object(this);
-        has_key = true;
+        G->has_key = true;
     }
 }
 
@@ -1063,11 +1197,11 @@ static void CHEST_init(OBJ *this) {
     this->timer = 20;
 }
 static void CHEST_update(OBJ *this) {
-    if (has_key) {
+    if (G->has_key) {
         this->timer -= 1;
         this->x = this->start - 1 + P8rnd(3);
         if (this->timer <= 0) {
-            sfx_timer = 20;
+            G->sfx_timer = 20;
             P8sfx(16);
             init_object(OBJ_FRUIT, this->x, this->y - 4);
             destroy_object(this);
@@ -1080,10 +1214,10 @@ static void PLATFORM_init(OBJ *this) {
     this->x -= 4;
     this->solids = false;
     this->hitbox.w = 16;
-    this->last = this->x;
+    this->platform.last = this->x;
 }
 static void PLATFORM_update(OBJ *this) {
-    this->spd.x = this->dir * 0.65;
+    this->spd.x = this->platform.dir * 0.65;
     if (this->x < -16) {
         this->x = 128;
     } else if (this->x > 128) {
@@ -1092,46 +1226,52 @@ static void PLATFORM_update(OBJ *this) {
     if (!OBJ_check(this, OBJ_PLAYER, 0, 0)) {
         OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, -1);
         if (hit != NULL) {
-            OBJ_move_x(hit, this->x - this->last, 1);
+            OBJ_move_x(hit, this->x - this->platform.last, 1);
         }
     }
-    this->last = this->x;
+    this->platform.last = this->x;
 }
 static void PLATFORM_draw(OBJ *this) {
-    P8spr(11, this->x, this->y - 1, 1, 1, false, false);
-    P8spr(12, this->x + 8, this->y - 1, 1, 1, false, false);
+    P8spr(11, this->x, this->y - 1, 2, 1, false, false);
 }
 
 // message
 // tile=86,
 // last=0,
 static void MESSAGE_draw(OBJ *this) {
-    this->text = "-- celeste mountain --#this memorial to those# perished on the climb";
+    this->message.text = "-- celeste mountain --#this memorial to those# perished on the climb";
     if (OBJ_check(this, OBJ_PLAYER, 4, 0)) {
-        if (this->index < strlen(this->text)) {
-            this->index += 0.5;
-            if (this->index >= this->last + 1) {
-                this->last += 1;
+        if (this->message.index < strlen(this->message.text)) {
+            this->message.index += 0.5;
+            if (this->message.index >= this->message.last + 1) {
+                this->message.last += 1;
                 P8sfx(35);
             }
         }
-        this->off2.x = 8;
-        this->off2.y = 96;
-        for (int i = 0; i < this->index; i++) {
-            if (this->text[i] != '#') {
-                P8rectfill(this->off2.x - 2, this->off2.y - 2, this->off2.x + 7, this->off2.y + 6, 7);
-                char charstr[2];
-                charstr[0] = this->text[i], charstr[1] = '\0';
-                P8print(charstr, this->off2.x, this->off2.y, 0);
-                this->off2.x += 5;
-            } else {
-                this->off2.x = 8;
-                this->off2.y += 7;
+        this->message.off2.x = 8;
+        this->message.off2.y = 96;
+        // a text box per line: the boxes of its characters make one rectangle,
+        // and none of them reaches the glyph before it (3x5, 5 pixels apart)
+        char const *text = this->message.text;
+        int start = 0; // of the line
+        for (int i = 0; i < this->message.index; i++) {
+            bool eol = text[i] == '#';
+            if (!eol)
+                this->message.off2.x += 5;
+            int n = i + !eol - start;
+            if (n > 0 && (eol || i + 1 >= this->message.index)) {
+                int x = this->message.off2.x - 5 * n, y = this->message.off2.y;
+                P8text_box(x - 2, y - 2, x + 5 * n + 2, y + 6, 7, text + start, n, x, y, 5, 0);
+            }
+            if (eol) {
+                this->message.off2.x = 8;
+                this->message.off2.y += 7;
+                start = i + 1;
             }
         }
     } else {
-        this->index = 0;
-        this->last = 0;
+        this->message.index = 0;
+        this->message.last = 0;
     }
 }
 
@@ -1145,25 +1285,26 @@ static void BIG_CHEST_draw(OBJ *this) {
     if (this->state == 0) {
         OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 8);
         if (hit != NULL && OBJ_is_solid(hit, 0, 1)) {
-            P8music(-1, 500, 7);
+            play_music(-1, 500, 7);
             P8sfx(37);
-            pause_player = true;
+            G->pause_player = true;
             hit->spd.x = 0;
             hit->spd.y = 0;
             this->state = 1;
             init_object(OBJ_SMOKE, this->x, this->y);
             init_object(OBJ_SMOKE, this->x + 8, this->y);
             this->timer = 60;
-            this->particle_count = 0;
+            G->chest_particle_count = 0;
         }
-        P8spr(96, this->x, this->y, 1, 1, false, false);
-        P8spr(97, this->x + 8, this->y, 1, 1, false, false);
+        // the lid and the bottom at once
+        P8spr(96, this->x, this->y, 2, 2, false, false);
+        return;
     } else if (this->state == 1) {
         this->timer -= 1;
-        shake = 5;
-        flash_bg = true;
-        if (this->timer <= 45 && this->particle_count < 50) {
-            this->particles[this->particle_count++] = (PARTICLE){
+        G->shake = 5;
+        G->flash_bg = true;
+        if (this->timer <= 45 && G->chest_particle_count < 50) {
+            G->chest_particles[G->chest_particle_count++] = (CHEST_PARTICLE){
                 .x = 1 + P8rnd(14),
                 .y = 0,
                 .spd = 8 + P8rnd(8),
@@ -1172,44 +1313,42 @@ static void BIG_CHEST_draw(OBJ *this) {
         }
         if (this->timer < 0) {
             this->state = 2;
-            this->particle_count = 0;
-            flash_bg = false;
-            new_bg = true;
+            G->chest_particle_count = 0;
+            G->flash_bg = false;
+            G->new_bg = true;
             init_object(OBJ_ORB, this->x + 4, this->y + 4);
-            pause_player = false;
+            G->pause_player = false;
         }
-        for (int i = 0; i < this->particle_count; i++) {
-            PARTICLE *p = &this->particles[i];
+        for (int i = 0; i < G->chest_particle_count; i++) {
+            CHEST_PARTICLE *p = &G->chest_particles[i];
             p->y += p->spd;
             P8line(this->x + p->x, this->y + 8 - p->y, this->x + p->x, P8min(this->y + 8 - p->y + p->h, this->y + 8), 7);
         }
     }
-    P8spr(112, this->x, this->y + 8, 1, 1, false, false);
-    P8spr(113, this->x + 8, this->y + 8, 1, 1, false, false);
+    P8spr(112, this->x, this->y + 8, 2, 1, false, false);
 }
 
 // orb
 static void ORB_init(OBJ *this) {
     this->spd.y = -4;
     this->solids = false;
-    this->particle_count = 0;
 }
 static void ORB_draw(OBJ *this) {
     this->spd.y = appr(this->spd.y, 0, 0.5);
     OBJ *hit = OBJ_collide(this, OBJ_PLAYER, 0, 0);
     bool destroy_self = false;
     if (this->spd.y == 0 && hit != NULL) {
-        music_timer = 45;
+        G->music_timer = 45;
         P8sfx(51);
-        freeze = 10;
-        shake = 10;
+        G->freeze = 10;
+        G->shake = 10;
         destroy_self = true; // LEMON: to avoid reading off dead object
-        max_djump = 2;
-        hit->djump = 2;
+        G->max_djump = 2;
+        hit->player.djump = 2;
     }
 
     P8spr(102, this->x, this->y, 1, 1, false, false);
-    float off = (float)frames / 30.f;
+    float off = (float)G->frames / 30.f;
     for (float i = 0; i <= 7; i += 1) {
         P8circfill(this->x + 4 + P8cos(off + i / 8.f) * 8, this->y + 4 + P8sin(off + i / 8.f) * 8, 1, 7);
     }
@@ -1221,35 +1360,35 @@ static void ORB_draw(OBJ *this) {
 // tile=118,
 static void FLAG_init(OBJ *this) {
     this->x += 5;
-    this->score = 0;
-    this->show = false;
+    this->flag.score = 0;
+    this->flag.show = false;
     for (int i = 0; i < FRUIT_COUNT; i++) {
-        if (got_fruit[i]) {
-            this->score += 1;
+        if (G->got_fruit[i]) {
+            this->flag.score += 1;
         }
     }
 }
 static void FLAG_draw(OBJ *this) {
-    this->spr = 118 + P8modulo(((float)frames / 5.f), 3);
+    this->spr = 118 + P8modulo(((float)G->frames / 5.f), 3);
     P8spr(this->spr, this->x, this->y, 1, 1, false, false);
-    if (this->show) {
+    if (this->flag.show) {
         P8rectfill(32, 2, 96, 31, 0);
         P8spr(26, 55, 6, 1, 1, false, false);
         {
             char str[16];
-            snprintf(str, sizeof(str), "x%i", this->score);
+            snprintf(str, sizeof(str), "x%i", this->flag.score);
             P8print(str, 64, 9, 7);
         }
         draw_time(49, 16);
         {
             char str[16];
-            snprintf(str, sizeof(str), "deaths:%i", deaths);
+            snprintf(str, sizeof(str), "deaths:%i", G->deaths);
             P8print(str, 48, 24, 7);
         }
     } else if (OBJ_check(this, OBJ_PLAYER, 0, 0)) {
         P8sfx(55);
-        sfx_timer = 30;
-        this->show = true;
+        G->sfx_timer = 30;
+        this->flag.show = true;
     }
 }
 
@@ -1262,21 +1401,21 @@ static void ROOM_TITLE_draw(OBJ *this) {
     if (this->delay < -30) {
         destroy_object(this);
     } else if (this->delay < 0) {
-        P8rectfill(24, 58, 104, 70, 0);
         // rect(26,64-10,102,64+10,7)
         // print("//-",31,64-2,13)
-        if (room.x == 3 && room.y == 1) {
-            P8print("old site", 48, 62, 7);
+        char str[16];
+        int x = 52;
+        if (G->room.x == 3 && G->room.y == 1) {
+            snprintf(str, sizeof(str), "old site");
+            x = 48;
         } else if (level_index() == 30) {
-            P8print("summit", 52, 62, 7);
+            snprintf(str, sizeof(str), "summit");
         } else {
             int level = (1 + level_index()) * 100;
-            {
-                char str[16];
-                snprintf(str, sizeof(str), "%i m", level);
-                P8print(str, 52 + (level < 1000 ? 2 : 0), 62, 7);
-            }
+            snprintf(str, sizeof(str), "%i m", level);
+            x += level < 1000 ? 2 : 0;
         }
+        P8text_box(24, 58, 104, 70, 0, str, -1, x, 62, 4, 7);
         // print("//-",86,64-2,13)
 
         draw_time(4, 4);
@@ -1288,13 +1427,13 @@ static void ROOM_TITLE_draw(OBJ *this) {
 
 static OBJ *init_object(OBJTYPE type, float x, float y) {
     // if (type.if_not_fruit!=NULL && got_fruit[1+level_index()]) {
-    if (OBJTYPE_prop[type].if_not_fruit && got_fruit[level_index()]) {
+    if (OBJTYPE_prop[type].if_not_fruit && G->got_fruit[level_index()]) {
         return NULL;
     }
     OBJ *obj = NULL;
     for (int i = 0; i < MAX_OBJECTS; i++) {
-        if (!objects[i].active) {
-            obj = &objects[i];
+        if (!G->objects[i].active) {
+            obj = &G->objects[i];
             break;
         }
     }
@@ -1304,8 +1443,7 @@ static OBJ *init_object(OBJTYPE type, float x, float y) {
         return NULL;
     }
     obj->active = true;
-    static short next_id = 0;
-    obj->id = next_id++;
+    obj->id = G->next_id++;
 
     obj->type = type;
     obj->collideable = true;
@@ -1330,23 +1468,23 @@ static OBJ *init_object(OBJTYPE type, float x, float y) {
 
 static void destroy_object(OBJ *obj) {
     // shift all slots to the right of this object to the left, necessary to simulate loading jank
-    assert(obj >= objects && obj < objects + MAX_OBJECTS);
-    for (; obj + 1 < objects + MAX_OBJECTS; obj++) {
+    assert(obj >= G->objects && obj < G->objects + MAX_OBJECTS);
+    for (; obj + 1 < G->objects + MAX_OBJECTS; obj++) {
         *obj = *(obj + 1);
     }
-    objects[MAX_OBJECTS - 1].active = false;
+    G->objects[MAX_OBJECTS - 1].active = false;
 }
 
 static void kill_player(OBJ *obj) {
-    sfx_timer = 12;
+    G->sfx_timer = 12;
     P8sfx(0);
-    deaths += 1;
-    shake = 10;
+    G->deaths += 1;
+    G->shake = 10;
     // destroy_object(obj);
     int dead_particles_count = 0;
     for (float dir = 0; dir <= 7; dir += 1) {
         float angle = (dir / 8);
-        dead_particles[dead_particles_count++] = (PARTICLE){
+        G->dead_particles[dead_particles_count++] = (PARTICLE){
             .active = true,
             .x = obj->x + 4,
             .y = obj->y + 4,
@@ -1365,55 +1503,55 @@ static void kill_player(OBJ *obj) {
 ////////////////////
 
 static void restart_room() {
-    will_restart = true;
-    delay_restart = 15;
+    G->will_restart = true;
+    G->delay_restart = 15;
 }
 
 static void next_room() {
-    if (room.x == 2 && room.y == 1) {
-        P8music(30, 500, 7);
-    } else if (room.x == 3 && room.y == 1) {
-        P8music(20, 500, 7);
-    } else if (room.x == 4 && room.y == 2) {
-        P8music(30, 500, 7);
-    } else if (room.x == 5 && room.y == 3) {
-        P8music(30, 500, 7);
-    }
-
-    if (room.x == 7) {
-        load_room(0, room.y + 1);
+    if (G->room.x == 2 && G->room.y == 1) {
+        play_music(30, 500, 7);
+    } else if (G->room.x == 3 && G->room.y == 1) {
+        play_music(20, 500, 7);
+    } else if (G->room.x == 4 && G->room.y == 2) {
+        play_music(30, 500, 7);
+    } else if (G->room.x == 5 && G->room.y == 3) {
+        play_music(30, 500, 7);
+    }
+
+    if (G->room.x == 7) {
+        load_room(0, G->room.y + 1);
     } else {
-        load_room(room.x + 1, room.y);
+        load_room(G->room.x + 1, G->room.y);
     }
 }
 
-static bool room_just_loaded = false; // for debugging loading jank
 static void load_room(int x, int y) {
-    has_dashed = false;
-    has_key = false;
-    room_just_loaded = true;
+    G->has_dashed = false;
+    G->has_key = false;
+    G->room_just_loaded = true;
 
     // int oldcount = 0;
     // remove existing objects
     for (int i = 0; i < MAX_OBJECTS; i++) {
         // oldcount += objects[i].active ? 1 : 0;
-        objects[i].active = false;
+        G->objects[i].active = false;
     }
     // int newcount = 0;
 
     // current room
-    room.x = x;
-    room.y = y;
+    G->room.x = x;
+    G->room.y = y;
+    build_collision_boards();
 
     // entities
     for (int tx = 0; tx <= 15; tx++) {
         for (int ty = 0; ty <= 15; ty++) {
-            int tile = P8mget(room.x * 16 + tx, room.y * 16 + ty);
+            int tile = P8mget(G->room.x * 16 + tx, G->room.y * 16 + ty);
             if (tile == 11) {
-                init_object(OBJ_PLATFORM, tx * 8, ty * 8)->dir = -1;
+                init_object(OBJ_PLATFORM, tx * 8, ty * 8)->platform.dir = -1;
                 // newcount++;
             } else if (tile == 12) {
-                init_object(OBJ_PLATFORM, tx * 8, ty * 8)->dir = 1;
+                init_object(OBJ_PLATFORM, tx * 8, ty * 8)->platform.dir = 1;
                 // newcount++;
             } else {
                 for (int type = 0; type < OBJTYPE_COUNT; type++) { // safe since types are ordered starting at 0
@@ -1436,55 +1574,56 @@ static void load_room(int x, int y) {
 // update function //
 /////////////////////
 
-void Celeste_P8_update() {
-    frames = ((frames + 1) % 30);
-    if (frames == 0 && level_index() < 30) {
-        seconds = ((seconds + 1) % 60);
-        if (seconds == 0) {
-            minutes += 1;
+void Celeste_P8_update(CelesteContext *ctx) {
+    bind(ctx);
+    G->frames = ((G->frames + 1) % 30);
+    if (G->frames == 0 && level_index() < 30) {
+        G->seconds = ((G->seconds + 1) % 60);
+        if (G->seconds == 0) {
+            G->minutes += 1;
         }
     }
 
-    if (music_timer > 0) {
-        music_timer -= 1;
-        if (music_timer <= 0) {
-            P8music(10, 0, 7);
+    if (G->music_timer > 0) {
+        G->music_timer -= 1;
+        if (G->music_timer <= 0) {
+            play_music(10, 0, 7);
         }
     }
 
-    if (sfx_timer > 0) {
-        sfx_timer -= 1;
+    if (G->sfx_timer > 0) {
+        G->sfx_timer -= 1;
     }
 
     // cancel if (freeze)
-    if (freeze > 0) {
-        freeze -= 1;
+    if (G->freeze > 0) {
+        G->freeze -= 1;
         return;
     }
 
     // screenshake
-    if (shake > 0) {
-        shake -= 1;
+    if (G->shake > 0) {
+        G->shake -= 1;
         P8camera(0, 0);
-        if (shake > 0) {
+        if (G->shake > 0) {
             P8camera(-2 + P8rnd(5), -2 + P8rnd(5));
         }
     }
 
     // restart (soon)
-    if (will_restart && delay_restart > 0) {
-        delay_restart -= 1;
-        if (delay_restart <= 0) {
-            will_restart = false;
-            load_room(room.x, room.y);
+    if (G->will_restart && G->delay_restart > 0) {
+        G->delay_restart -= 1;
+        if (G->delay_restart <= 0) {
+            G->will_restart = false;
+            load_room(G->room.x, G->room.y);
         }
     }
 
     // printf("BEGIN FRAME\n");
-    room_just_loaded = false;
+    G->room_just_loaded = false;
     // update each object
     for (int i = 0; i < MAX_OBJECTS; i++) {
-        OBJ *obj = &objects[i];
+        OBJ *obj = &G->objects[i];
 
     redo_update_slot:
         if (!obj->active)
@@ -1497,8 +1636,8 @@ void Celeste_P8_update() {
             OBJ_PROP(obj).update(obj);
         }
 
-        if (room_just_loaded) /*printf("update(): load room (player was: #%i)\n", i),*/
-            room_just_loaded = false;
+        if (G->room_just_loaded) /*printf("update(): load room (player was: #%i)\n", i),*/
+            G->room_just_loaded = false;
         /*LEMON: necessary to correctly simulate loading jank: due to the way pico-8's foreach() works,
          *       when element #i is removed and replaced by another different object, the function iterates
          *       over this index again. thus for example, the player is in slot N before a new room is loaded,
@@ -1511,15 +1650,15 @@ void Celeste_P8_update() {
 
     // start game
     if (is_title()) {
-        if (!start_game && (P8btn(k_jump) || P8btn(k_dash))) {
-            P8music(-1, 0, 0);
-            start_game_flash = 50;
-            start_game = true;
+        if (!G->start_game && (P8btn(k_jump) || P8btn(k_dash))) {
+            play_music(-1, 0, 0);
+            G->start_game_flash = 50;
+            G->start_game = true;
             P8sfx(38);
         }
-        if (start_game) {
-            start_game_flash -= 1;
-            if (start_game_flash <= -30) {
+        if (G->start_game) {
+            G->start_game_flash -= 1;
+            if (G->start_game_flash <= -30) {
                 begin_game();
             }
         }
@@ -1528,24 +1667,26 @@ void Celeste_P8_update() {
 
 // drawing functions //
 //////////////////////-
-void Celeste_P8_draw() {
-    if (freeze > 0) {
+void Celeste_P8_draw(CelesteContext *ctx) {
+    bind(ctx);
+    if (G->freeze > 0) {
         return;
     }
+    P8frame_begin();
 
     // reset all palette values
     P8pal_reset();
 
     // start game flash
-    if (start_game) {
+    if (G->start_game) {
         int c = 10;
-        if (start_game_flash > 10) {
-            if (frames % 10 < 5) {
+        if (G->start_game_flash > 10) {
+            if (G->frames % 10 < 5) {
                 c = 7;
             }
-        } else if (start_game_flash > 5) {
+        } else if (G->start_game_flash > 5) {
             c = 2;
-        } else if (start_game_flash > 0) {
+        } else if (G->start_game_flash > 0) {
             c = 1;
         } else {
             c = 0;
@@ -1562,9 +1703,9 @@ void Celeste_P8_draw() {
 
     // clear screen
     int bg_col = 0;
-    if (flash_bg) {
-        bg_col = frames / 5;
-    } else if (new_bg) {
+    if (G->flash_bg) {
+        bg_col = G->frames / 5;
+    } else if (G->new_bg) {
         bg_col = 2;
     }
     P8rectfill(0, 0, 128, 128, bg_col);
@@ -1572,9 +1713,9 @@ void Celeste_P8_draw() {
     // clouds
     if (!is_title()) {
         for (int i = 0; i <= 16; i++) {
-            CLOUD *c = &clouds[i];
+            CLOUD *c = &G->clouds[i];
             c->x += c->spd;
-            P8rectfill(c->x, c->y, c->x + c->w, c->y + 4 + (1 - c->w / 64.0) * 12, new_bg ? 14 : 1);
+            P8rectfill(c->x, c->y, c->x + c->w, c->y + 4 + (1 - c->w / 64.0) * 12, G->new_bg ? 14 : 1);
             if (c->x > 128) {
                 c->x = -c->w;
                 c->y = P8rnd(128 - 8);
@@ -1583,11 +1724,11 @@ void Celeste_P8_draw() {
     }
 
     // draw bg terrain
-    P8map(room.x * 16, room.y * 16, 0, 0, 16, 16, 4);
+    P8map(G->room.x * 16, G->room.y * 16, 0, 0, 16, 16, 4);
 
     // platforms/big chest
     for (int i = 0; i < MAX_OBJECTS; i++) {
-        OBJ *o = &objects[i];
+        OBJ *o = &G->objects[i];
         if (o->active && (o->type == OBJ_PLATFORM || o->type == OBJ_BIG_CHEST)) {
             draw_object(o);
         }
@@ -1595,11 +1736,11 @@ void Celeste_P8_draw() {
 
     // draw terrain
     int off = is_title() ? -4 : 0;
-    P8map(room.x * 16, room.y * 16, off, 0, 16, 16, 2);
+    P8map(G->room.x * 16, G->room.y * 16, off, 0, 16, 16, 2);
 
     // draw objects
     for (int i = 0; i < MAX_OBJECTS; i++) {
-        OBJ *o = &objects[i];
+        OBJ *o = &G->objects[i];
     redo_draw:;
         short this_id = o->id;
         if (o->active && (o->type != OBJ_PLATFORM && o->type != OBJ_BIG_CHEST)) {
@@ -1612,11 +1753,11 @@ void Celeste_P8_draw() {
     }
 
     // draw fg terrain
-    P8map(room.x * 16, room.y * 16, 0, 0, 16, 16, 8);
+    P8map(G->room.x * 16, G->room.y * 16, 0, 0, 16, 16, 8);
 
     // particles
     for (int i = 0; i <= 24; i++) {
-        PARTICLE *p = &particles[i];
+        PARTICLE *p = &G->particles[i];
         p->x += p->spd;
         p->y += P8sin(p->off);
         p->off += P8min(0.05, p->spd / 32);
@@ -1630,7 +1771,7 @@ void Celeste_P8_draw() {
 
     // dead particles
     for (int i = 0; i <= 7; i++) {
-        PARTICLE *p = &dead_particles[i];
+        PARTICLE *p = &G->dead_particles[i];
         if (p->active) {
             p->x += p->spd2.x;
             p->y += p->spd2.y;
@@ -1660,8 +1801,8 @@ void Celeste_P8_draw() {
     if (level_index() == 30) {
         OBJ *p = NULL;
         for (int i = 0; i < MAX_OBJECTS; i++) {
-            if (objects[i].active && objects[i].type == OBJ_PLAYER) {
-                p = &objects[i];
+            if (G->objects[i].active && G->objects[i].type == OBJ_PLAYER) {
+                p = &G->objects[i];
                 break;
             }
         }
@@ -1671,6 +1812,8 @@ void Celeste_P8_draw() {
             P8rectfill(128 - diff, 0, 128, 128, 0);
         }
     }
+
+    P8frame_end();
 }
 
 static void draw_object(OBJ *obj) {
@@ -1682,16 +1825,13 @@ static void draw_object(OBJ *obj) {
 }
 
 static void draw_time(float x, float y) {
-    int s = seconds;
-    int m = minutes % 60;
-    int h = minutes / 60;
+    int s = G->seconds;
+    int m = G->minutes % 60;
+    int h = G->minutes / 60;
 
-    P8rectfill(x, y, x + 32, y + 6, 0);
-    {
-        char str[27];
-        snprintf(str, sizeof(str), "%.2i:%.2i:%.2i", h, m, s);
-        P8print(str, x + 1, y + 1, 7);
-    }
+    char str[27];
+    snprintf(str, sizeof(str), "%.2i:%.2i:%.2i", h, m, s);
+    P8text_box(x, y, x + 32, y + 6, 0, str, -1, x + 1, y + 1, 4, 7);
 }
 
 // helper functions //
@@ -1722,44 +1862,406 @@ static bool ice_at(int x, int y, int w, int h) {
     return tile_flag_at(x, y, w, h, 4);
 }
 
-static bool tile_flag_at(int x, int y, int w, int h, int flag) {
-    for (int i = (int)P8max(0, P8flr(x / 8)); i <= P8min(15, (x + w - 1) / 8); i++) {
-        for (int j = (int)P8max(0, P8flr(y / 8)); j <= P8min(15, (y + h - 1) / 8); j++) {
-            if (P8fget(tile_at(i, j), flag)) {
-                return true;
+static void build_collision_boards() {
+    memset(G->flag_board, 0, sizeof G->flag_board);
+    memset(G->spikes_board, 0, sizeof G->spikes_board);
+    for (int j = 0; j <= 15; j++) {
+        for (int i = 0; i <= 15; i++) {
+            int tile = tile_at(i, j);
+            for (int flag = 0; flag < 8; flag++) {
+                if (P8fget(tile, flag)) {
+                    G->flag_board[flag][j] |= 1 << i;
+                }
+            }
+            int spikes = tile == 17 ? 0 : tile == 27 ? 1
+                                      : tile == 43   ? 2
+                                      : tile == 59   ? 3
+                                                     : -1;
+            if (spikes >= 0) {
+                G->spikes_board[spikes][j] |= 1 << i;
             }
         }
     }
-    return false;
+}
+
+// is any bit set in columns [i0,i1] of rows [j0,j1]
+static bool board_any(unsigned short const board[16], int i0, int i1, int j0, int j1) {
+    if (i0 > i1 || j0 > j1) {
+        return false;
+    }
+    unsigned cols = (2u << i1) - (1u << i0);
+    unsigned rows = 0;
+    for (int j = j0; j <= j1; j++) {
+        rows |= board[j];
+    }
+    return (rows & cols) != 0;
+}
+
+// same range as P8max(0, P8flr(v / 8)) .. P8min(15, (v + size - 1) / 8),
+// with integer arithmetic
+static inline void tile_range(int v, int size, int *t0, int *t1) {
+    *t0 = v / 8 < 0 ? 0 : v / 8;
+    *t1 = (v + size - 1) / 8 > 15 ? 15 : (v + size - 1) / 8;
+}
+
+// floor(v / 8)
+static inline int tile_floor(float v) {
+    float t = v / 8;
+    int i = (int)t;
+    return i - (t < i);
+}
+
+static bool tile_flag_at(int x, int y, int w, int h, int flag) {
+    int i0, i1, j0, j1;
+    tile_range(x, w, &i0, &i1);
+    tile_range(y, h, &j0, &j1);
+    return board_any(G->flag_board[flag], i0, i1, j0, j1);
 }
 
 static int tile_at(int x, int y) {
-    return P8mget(room.x * 16 + x, room.y * 16 + y);
+    return P8mget(G->room.x * 16 + x, G->room.y * 16 + y);
 }
 
 static bool spikes_at(float x, float y, int w, int h, float xspd, float yspd) {
-    for (int i = (int)P8max(0, P8flr(x / 8)); i <= P8min(15, (x + w - 1) / 8); i++) {
-        for (int j = (int)P8max(0, P8flr(y / 8)); j <= P8min(15, (y + h - 1) / 8); j++) {
-            int tile = tile_at(i, j);
-            if (tile == 17 && (P8modulo(y + h - 1, 8) >= 6 || y + h == j * 8 + 8) && yspd >= 0) {
-                return true;
-            } else if (tile == 27 && P8modulo(y, 8) <= 2 && yspd <= 0) {
-                return true;
-            } else if (tile == 43 && P8modulo(x, 8) <= 2 && xspd <= 0) {
-                return true;
-            } else if (tile == 59 && (P8modulo(x + w - 1, 8) >= 6 || x + w == i * 8 + 8) && xspd >= 0) {
-                return true;
-            }
-        }
+    int i0 = tile_floor(x), i1 = tile_floor(x + w - 1);
+    int j0 = tile_floor(y), j1 = tile_floor(y + h - 1);
+    i0 = i0 < 0 ? 0 : i0, i1 = i1 > 15 ? 15 : i1;
+    j0 = j0 < 0 ? 0 : j0, j1 = j1 > 15 ? 15 : j1;
+
+    // the spikes in tiles 17 and 59 only kill near the bottom/right edge of
+    // the hitbox, or on the row/column whose far edge the hitbox ends at
+    if (yspd >= 0 && board_any(G->spikes_board[0], i0, i1, j0, j1)) {
+        if (P8modulo(y + h - 1, 8) >= 6)
+            return true;
+        int j = tile_floor(y + h) - 1;
+        if (y + h == j * 8 + 8 && j >= j0 && j <= j1 && board_any(G->spikes_board[0], i0, i1, j, j))
+            return true;
+    }
+    if (yspd <= 0 && board_any(G->spikes_board[1], i0, i1, j0, j1) && P8modulo(y, 8) <= 2) {
+        return true;
+    }
+    if (xspd <= 0 && board_any(G->spikes_board[2], i0, i1, j0, j1) && P8modulo(x, 8) <= 2) {
+        return true;
+    }
+    if (xspd >= 0 && board_any(G->spikes_board[3], i0, i1, j0, j1)) {
+        if (P8modulo(x + w - 1, 8) >= 6)
+            return true;
+        int i = tile_floor(x + w) - 1;
+        if (x + w == i * 8 + 8 && i >= i0 && i <= i1 && board_any(G->spikes_board[3], i, i, j0, j1))
+            return true;
     }
     return false;
 }
 
 //////////END/////////
 
-void Celeste_P8__DEBUG(void) {
+void Celeste_P8__DEBUG(CelesteContext *ctx) {
+    bind(ctx);
     if (is_title())
-        start_game = true, start_game_flash = 1;
+        G->start_game = true, G->start_game_flash = 1;
     else
         next_room();
 }
+
+// savestates //
+////////////////
+
+size_t Celeste_P8_get_state_size(void) {
+    return sizeof(CelesteContext);
+}
+
+void Celeste_P8_save_state(CelesteContext const *ctx, void *st) {
+    memcpy(st, ctx, sizeof *ctx);
+}
+
+void Celeste_P8_load_state(CelesteContext *ctx, void const *st) {
+    int music = ctx->game.music;
+    memcpy(ctx, st, sizeof *ctx);
+    if (ctx->game.music != music) {
+        P8music(ctx->game.music, 0, 7);
+    }
+}
+
+// progress //
+//////////////
+
+void Celeste_P8_get_progress(CelesteContext const *ctx, CelesteProgress *progress) {
+    GAME_STATE const *G = &ctx->game;
+    progress->level = G->room.x % 8 + G->room.y * 8;
+    progress->deaths = G->deaths;
+    progress->fruits = 0;
+    for (int i = 0; i < FRUIT_COUNT; i++)
+        progress->fruits += G->got_fruit[i];
+    progress->player = false;
+    for (int i = 0; i < MAX_OBJECTS; i++) {
+        OBJ const *o = &G->objects[i];
+        if (o->active && o->type == OBJ_PLAYER) {
+            progress->player = true;
+            progress->player_x = o->x, progress->player_y = o->y;
+            break;
+        }
+    }
+}
+
+// fingerprints //
+//////////////////
+
+// the fields are written out as 32-bit words, which are then hashed
+// xxh3-style: 8 independent 64-bit lanes over 64-byte stripes, each keyed
+// with its own constant. the sse2 path computes exactly what the scalar one
+// does, so fingerprints do not depend on the build
+#define PRIME64_1 0x9E3779B185EBCA87ull
+#define PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define PRIME64_3 0x165667B19E3779F9ull
+#define PRIME64_4 0x85EBCA77C2B2AE63ull
+#define PRIME64_5 0x27D4EB2F165667C5ull
+
+typedef struct {
+    uint32_t w[2048 + 16]; // enough for every object being a player, and a stripe of padding
+    size_t n;              // not an int, which the stores to w could alias
+} HASHER;
+
+static inline void hash_u32(HASHER *h, uint32_t v) {
+    assert(h->n < 2048);
+    h->w[h->n++] = v;
+}
+
+static inline void hash_float(HASHER *h, float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof u);
+    hash_u32(h, u);
+}
+
+// a run of floats without padding in between
+static inline void hash_floats(HASHER *h, float const *v, size_t n) {
+    assert(h->n + n <= 2048);
+    memcpy(&h->w[h->n], v, n * sizeof *v);
+    h->n += n;
+}
+
+static inline uint64_t rotl64(uint64_t v, int r) {
+    return (v << r) | (v >> (64 - r));
+}
+
+alignas(16) static uint64_t const hash_keys[8] = {
+    0xbe4ba423396cfeb8ull, 0x1cad21f72c81017cull, 0xdb979083e96dd4deull, 0x1f67b3b7a4a44072ull,
+    0x78e5c0cc4ee679cbull, 0x2172ffcc7dd05a82ull, 0x8e2443f7744608b8ull, 0x4c263a81e69035e0ull,
+};
+
+// hash of the words written since the last call
+static uint64_t hash_finish(HASHER *h) {
+    size_t len = h->n * sizeof *h->w;
+    // pad to whole stripes
+    while (h->n % 16)
+        h->w[h->n++] = 0;
+    unsigned char const *p = (unsigned char const *)h->w;
+    unsigned char const *end = p + h->n * sizeof *h->w;
+
+    alignas(16) uint64_t acc[8] = {
+        PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME64_5, PRIME64_1 + PRIME64_2, PRIME64_2 + PRIME64_3, PRIME64_3 + PRIME64_4
+    };
+#if defined(__SSE2__)
+    __m128i a[4];
+    for (int j = 0; j < 4; j++)
+        a[j] = _mm_load_si128((__m128i const *)acc + j);
+    for (; p < end; p += 64) {
+        for (int j = 0; j < 4; j++) {
+            __m128i d = _mm_loadu_si128((__m128i const *)p + j);
+            __m128i dk = _mm_xor_si128(d, _mm_load_si128((__m128i const *)hash_keys + j));
+            // low half times high half of each lane, and the lanes swapped
+            __m128i prod = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m128i swap = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+            a[j] = _mm_add_epi64(a[j], _mm_add_epi64(prod, swap));
+        }
+    }
+    for (int j = 0; j < 4; j++)
+        _mm_store_si128((__m128i *)acc + j, a[j]);
+#else
+    for (; p < end; p += 64) {
+        uint64_t d[8];
+        memcpy(d, p, sizeof d);
+        for (int i = 0; i < 8; i++) {
+            uint64_t dk = d[i] ^ hash_keys[i];
+            acc[i] += (dk & 0xffffffff) * (dk >> 32) + d[i ^ 1];
+        }
+    }
+#endif
+
+    uint64_t r = len * PRIME64_1;
+    for (int i = 0; i < 8; i++)
+        r = rotl64(r ^ (rotl64(acc[i] * PRIME64_2, 31) * PRIME64_1), 27) * PRIME64_1 + PRIME64_4;
+    r ^= r >> 33;
+    r *= PRIME64_2;
+    r ^= r >> 29;
+    r *= PRIME64_3;
+    r ^= r >> 32;
+
+    h->n = 0;
+    return r;
+}
+
+static void hash_particle(HASHER *h, PARTICLE const *p) {
+    hash_u32(h, p->active);
+    hash_floats(h, &p->x, (sizeof *p - offsetof(PARTICLE, x)) / sizeof(float)); // x to spd2.y
+}
+
+// `key` leaves out what has no effect on the game's future: the id (taken from
+// a counter that smoke also advances) and the player's animation. the rng is
+// left to Celeste_P8_hash_key
+static void hash_object(HASHER *h, OBJ const *o, bool key) {
+    bool animation = !key || o->type != OBJ_PLAYER;
+    hash_u32(h, o->type);
+    if (!key)
+        hash_u32(h, o->id);
+    hash_u32(h, o->collideable), hash_u32(h, o->solids);
+    hash_float(h, o->x), hash_float(h, o->y);
+    hash_u32(h, o->hitbox.x), hash_u32(h, o->hitbox.y), hash_u32(h, o->hitbox.w), hash_u32(h, o->hitbox.h);
+    hash_float(h, o->spd.x), hash_float(h, o->spd.y);
+    hash_float(h, o->rem.x), hash_float(h, o->rem.y);
+    if (animation)
+        hash_float(h, o->spr);
+    hash_u32(h, o->flip_x), hash_u32(h, o->flip_y);
+    hash_u32(h, o->state), hash_u32(h, o->delay), hash_u32(h, o->timer);
+    hash_float(h, o->start);
+
+    switch (o->type) {
+    case OBJ_PLAYER:
+    case OBJ_PLAYER_SPAWN:
+        hash_u32(h, o->player.p_jump), hash_u32(h, o->player.p_dash);
+        hash_u32(h, o->player.grace), hash_u32(h, o->player.jbuffer);
+        hash_u32(h, o->player.djump), hash_u32(h, o->player.dash_time);
+        hash_u32(h, o->player.dash_effect_time);
+        hash_float(h, o->player.dash_target.x), hash_float(h, o->player.dash_target.y);
+        hash_float(h, o->player.dash_accel.x), hash_float(h, o->player.dash_accel.y);
+        if (animation)
+            hash_float(h, o->player.spr_off);
+        hash_u32(h, o->player.was_on_ground);
+        if (!animation)
+            break;
+        for (int i = 0; i < 5; i++) {
+            HAIR const *hair = &o->player.hair[i];
+            hash_float(h, hair->x), hash_float(h, hair->y), hash_float(h, hair->size);
+            hash_u32(h, hair->isLast);
+        }
+        hash_float(h, o->player.target.x), hash_float(h, o->player.target.y);
+        break;
+    case OBJ_SPRING:
+        hash_u32(h, o->spring.hide_in), hash_u32(h, o->spring.hide_for);
+        break;
+    case OBJ_BALLOON:
+        hash_float(h, o->balloon.offset);
+        break;
+    case OBJ_FRUIT:
+        hash_float(h, o->fruit.off);
+        break;
+    case OBJ_FLY_FRUIT:
+        hash_u32(h, o->fly_fruit.fly), hash_float(h, o->fly_fruit.step);
+        hash_u32(h, o->fly_fruit.sfx_delay);
+        break;
+    case OBJ_LIFEUP:
+        hash_u32(h, o->lifeup.duration), hash_float(h, o->lifeup.flash);
+        break;
+    case OBJ_PLATFORM:
+        hash_float(h, o->platform.last), hash_float(h, o->platform.dir);
+        break;
+    case OBJ_MESSAGE:
+        hash_float(h, o->message.index), hash_float(h, o->message.last);
+        hash_u32(h, o->message.off2.x), hash_u32(h, o->message.off2.y);
+        break;
+    case OBJ_FLAG:
+        hash_u32(h, o->flag.score), hash_u32(h, o->flag.show);
+        break;
+    default:
+        break;
+    }
+}
+
+void Celeste_P8_hash_state(CelesteContext const *ctx, uint64_t hashes[CELESTE_P8_HASH_COUNT]) {
+    GAME_STATE const *G = &ctx->game;
+    HASHER h, player;
+    h.n = player.n = 0;
+
+    for (int i = 0; i < MAX_OBJECTS; i++) {
+        OBJ const *o = &G->objects[i];
+        if (!o->active)
+            continue;
+        if (o->type == OBJ_PLAYER) {
+            hash_u32(&player, i);
+            hash_object(&player, o, false);
+        } else {
+            hash_u32(&h, i);
+            hash_object(&h, o, false);
+        }
+    }
+    hashes[CELESTE_P8_HASH_OBJECTS] = hash_finish(&h);
+    hashes[CELESTE_P8_HASH_PLAYER] = hash_finish(&player);
+
+    hash_u32(&h, G->room.x), hash_u32(&h, G->room.y);
+    hash_u32(&h, G->has_key), hash_u32(&h, G->has_dashed);
+    hash_u32(&h, G->will_restart), hash_u32(&h, G->delay_restart);
+    hash_u32(&h, G->freeze), hash_u32(&h, G->shake);
+    hash_u32(&h, G->pause_player), hash_u32(&h, G->flash_bg), hash_u32(&h, G->new_bg);
+    hash_u32(&h, G->start_game), hash_u32(&h, G->start_game_flash);
+    hash_u32(&h, G->next_id);
+    hashes[CELESTE_P8_HASH_ROOM] = hash_finish(&h);
+
+    hash_u32(&h, G->frames), hash_u32(&h, G->seconds), hash_u32(&h, G->minutes);
+    hash_u32(&h, G->deaths);
+    hash_u32(&h, G->sfx_timer), hash_u32(&h, G->music_timer), hash_u32(&h, G->music);
+    hashes[CELESTE_P8_HASH_TIMERS] = hash_finish(&h);
+
+    for (int i = 0; i < FRUIT_COUNT; i++)
+        hash_u32(&h, G->got_fruit[i]);
+    hash_u32(&h, G->max_djump);
+    hashes[CELESTE_P8_HASH_FRUIT] = hash_finish(&h);
+
+    for (int i = 0; i < 17; i++)
+        hash_floats(&h, &G->clouds[i].x, 4);
+    for (int i = 0; i < 25; i++)
+        hash_particle(&h, &G->particles[i]);
+    for (int i = 0; i < 8; i++)
+        hash_particle(&h, &G->dead_particles[i]);
+    hash_u32(&h, G->chest_particle_count);
+    for (int i = 0; i < G->chest_particle_count; i++)
+        hash_floats(&h, &G->chest_particles[i].x, 4);
+    hashes[CELESTE_P8_HASH_EFFECTS] = hash_finish(&h);
+
+    hash_u32(&h, ctx->p8.rnd_seed_lo), hash_u32(&h, ctx->p8.rnd_seed_hi);
+    hash_u32(&h, ctx->p8.camera_x), hash_u32(&h, ctx->p8.camera_y);
+    hashes[CELESTE_P8_HASH_RNG] = hash_finish(&h);
+}
+
+uint64_t Celeste_P8_hash_key(CelesteContext const *ctx) {
+    GAME_STATE const *G = &ctx->game;
+    HASHER h;
+    h.n = 0;
+
+    for (int i = 0; i < MAX_OBJECTS; i++) {
+        OBJ const *o = &G->objects[i];
+        if (o->active && o->type != OBJ_SMOKE)
+            hash_object(&h, o, true);
+    }
+    hash_u32(&h, G->room.x), hash_u32(&h, G->room.y);
+    hash_u32(&h, G->has_key), hash_u32(&h, G->has_dashed);
+    hash_u32(&h, G->will_restart), hash_u32(&h, G->delay_restart);
+    hash_u32(&h, G->freeze), hash_u32(&h, G->pause_player);
+    hash_u32(&h, G->max_djump);
+    // an unlocking chest jitters with the rng, and its fruit spawns where the
+    // chest was last
+    for (int i = 0; G->has_key && i < MAX_OBJECTS; i++) {
+        if (G->objects[i].active && G->objects[i].type == OBJ_CHEST) {
+            hash_u32(&h, ctx->p8.rnd_seed_lo), hash_u32(&h, ctx->p8.rnd_seed_hi);
+            break;
+        }
+    }
+    return hash_finish(&h);
+}
+
+char const *Celeste_P8_hash_name(int component) {
+    static char const *const names[] = {
+#define X(name, str) str,
+        CELESTE_P8_HASH_LIST()
+#undef X
+    };
+    return component >= 0 && component < CELESTE_P8_HASH_COUNT ? names[component] : "?";
+}
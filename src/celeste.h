@@ -1,11 +1,78 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
-void Celeste_P8_init(void);
+// a game instance. instances are independent, any number of them can be run,
+// each by one thread at a time. they only share read-only data (the map,
+// tile flags and sprite sheets)
+typedef struct CelesteContext CelesteContext;
 
-void Celeste_P8_update(void);
+CelesteContext *Celeste_P8_create(void);
 
-void Celeste_P8_draw(void);
+void Celeste_P8_destroy(CelesteContext *ctx);
 
-void Celeste_P8__DEBUG(void);
+void Celeste_P8_set_rndseed(CelesteContext *ctx, unsigned seed);
+
+void Celeste_P8_init(CelesteContext *ctx);
+
+// update reads the buttons from the calling thread's P8buttons, draw draws
+// into its p8gfx_screen
+void Celeste_P8_update(CelesteContext *ctx);
+
+void Celeste_P8_draw(CelesteContext *ctx);
+
+void Celeste_P8__DEBUG(CelesteContext *ctx);
+
+// savestates: a snapshot is an opaque blob of Celeste_P8_get_state_size()
+// bytes covering the whole game state, including the rng, camera and music.
+// it is only valid for the build that produced it, CELESTE_P8_STATE_VERSION
+// is bumped whenever its layout changes
+#define CELESTE_P8_STATE_VERSION 1
+
+size_t Celeste_P8_get_state_size(void);
+
+void Celeste_P8_save_state(CelesteContext const *ctx, void *st);
+
+void Celeste_P8_load_state(CelesteContext *ctx, void const *st);
+
+// progress of the run, for tools that drive the game
+typedef struct {
+    int level; // 0-29, 30 is the summit, 31 the title screen
+    int deaths;
+    int fruits;
+    bool player; // false while dead or spawning
+    float player_x, player_y;
+} CelesteProgress;
+
+void Celeste_P8_get_progress(CelesteContext const *ctx, CelesteProgress *progress);
+
+// fingerprints: one 64-bit hash per component of the game state, computed
+// field by field so that they do not depend on padding or on the layout of
+// the savestates. used to find the first frame where two runs diverge
+#define CELESTE_P8_HASH_LIST() \
+    X(OBJECTS, "objects")      \
+    X(PLAYER, "player")        \
+    X(ROOM, "room")            \
+    X(TIMERS, "timers")        \
+    X(FRUIT, "fruit")          \
+    X(EFFECTS, "effects")      \
+    X(RNG, "rng")
+
+enum {
+#define X(name, str) CELESTE_P8_HASH_##name,
+    CELESTE_P8_HASH_LIST()
+#undef X
+        CELESTE_P8_HASH_COUNT
+};
+
+void Celeste_P8_hash_state(CelesteContext const *ctx, uint64_t hashes[CELESTE_P8_HASH_COUNT]);
+
+char const *Celeste_P8_hash_name(int component);
+
+// hash of what decides how the game continues from here: the player's movement
+// state, the objects and the room. effects, animations, timers and smoke are
+// left out, so states that only differ in those have the same key. the rng is
+// left out too, except while a chest unlocks, when it decides where the fruit
+// spawns
+uint64_t Celeste_P8_hash_key(CelesteContext const *ctx);
@@ -0,0 +1,165 @@
+#include <mutex>
+
+#include "celeste.h"
+#include "env.h"
+#include "p8.h"
+
+typedef struct {
+    CelesteContext *game;
+    int steps;
+    CelesteProgress progress; // at the previous step
+} INSTANCE;
+
+struct CelesteEnv {
+    int n;
+    int factor;
+    int max_steps;
+    unsigned seed; // of the next instance reset
+    INSTANCE *instances;
+    void *start;           // state at the beginning of the first level
+    unsigned char *frames; // full resolution frames, when downsampling
+};
+
+// sprite sheets //
+///////////////////
+
+static std::mutex sheets_lock;
+static bool sheets_loaded;
+
+static bool load_sheets(char const *dir) {
+    std::lock_guard<std::mutex> lock(sheets_lock);
+    if (!sheets_loaded)
+        sheets_loaded = p8gfx_load_sheets(dir);
+    return sheets_loaded;
+}
+
+// instances //
+///////////////
+
+// draws the current frame and writes the observation
+static void observe(CelesteEnv *env, int i, unsigned char *obs) {
+    size_t size = env_observation_size(env);
+    unsigned char *out = obs + i * size;
+    unsigned char *frame = env->factor == 1 ? out : env->frames + i * PICO8_W * PICO8_H;
+
+    unsigned char *screen = p8gfx_screen;
+    p8gfx_screen = frame;
+    Celeste_P8_draw(env->instances[i].game);
+    p8gfx_screen = screen;
+
+    if (env->factor > 1) {
+        int f = env->factor;
+        for (int y = 0; y < PICO8_H; y += f)
+            for (int x = 0; x < PICO8_W; x += f)
+                *out++ = frame[x + y * PICO8_W];
+    }
+}
+
+static void reset_instance(CelesteEnv *env, int i, unsigned char *obs) {
+    INSTANCE *inst = &env->instances[i];
+    Celeste_P8_load_state(inst->game, env->start);
+    Celeste_P8_set_rndseed(inst->game, env->seed++);
+    Celeste_P8_get_progress(inst->game, &inst->progress);
+    inst->steps = 0;
+    observe(env, i, obs);
+}
+
+CelesteEnv *env_create(int n, char const *data_dir) {
+    if (n <= 0 || !load_sheets(data_dir))
+        return NULL;
+    CelesteEnv *env = (CelesteEnv *)calloc(1, sizeof *env);
+    if (!env)
+        return NULL;
+    env->n = n;
+    env->factor = 1;
+    env->max_steps = 30 * 60 * 5;
+    env->instances = (INSTANCE *)calloc(n, sizeof *env->instances);
+    env->start = malloc(Celeste_P8_get_state_size());
+    env->frames = (unsigned char *)calloc(n, PICO8_W * PICO8_H);
+    bool ok = env->instances && env->start && env->frames;
+    for (int i = 0; ok && i < n; i++)
+        ok = (env->instances[i].game = Celeste_P8_create()) != NULL;
+    if (!ok) {
+        env_destroy(env);
+        return NULL;
+    }
+
+    // skip the title screen once, every episode starts from a copy
+    CelesteContext *game = env->instances[0].game;
+    CelesteProgress progress;
+    unsigned buttons = P8buttons;
+    P8buttons = 0;
+    Celeste_P8_init(game);
+    Celeste_P8__DEBUG(game);
+    do {
+        Celeste_P8_update(game);
+        Celeste_P8_get_progress(game, &progress);
+    } while (progress.level != 0);
+    P8buttons = buttons;
+    Celeste_P8_save_state(game, env->start);
+    return env;
+}
+
+void env_destroy(CelesteEnv *env) {
+    if (!env)
+        return;
+    for (int i = 0; env->instances && i < env->n; i++)
+        Celeste_P8_destroy(env->instances[i].game);
+    free(env->instances);
+    free(env->start);
+    free(env->frames);
+    free(env);
+}
+
+int env_set_observation(CelesteEnv *env, int factor) {
+    if (factor != 1 && factor != 2 && factor != 4)
+        return 0;
+    env->factor = factor;
+    return 1;
+}
+
+size_t env_observation_size(CelesteEnv const *env) {
+    return (PICO8_W / env->factor) * (PICO8_H / env->factor);
+}
+
+void env_set_max_steps(CelesteEnv *env, int steps) {
+    env->max_steps = steps;
+}
+
+void env_reset(CelesteEnv *env, unsigned seed, unsigned char *obs) {
+    env->seed = seed;
+    for (int i = 0; i < env->n; i++)
+        reset_instance(env, i, obs);
+}
+
+void env_step(CelesteEnv *env, unsigned char const *actions, unsigned char *obs, float *rewards,
+              unsigned char *dones) {
+    unsigned buttons = P8buttons;
+    for (int i = 0; i < env->n; i++) {
+        INSTANCE *inst = &env->instances[i];
+        P8buttons = actions[i] & 0x3f;
+        Celeste_P8_update(inst->game);
+
+        CelesteProgress progress;
+        Celeste_P8_get_progress(inst->game, &progress);
+        float reward = 0;
+        bool done = false;
+        if (progress.level > inst->progress.level)
+            reward += progress.level - inst->progress.level;
+        if (progress.deaths > inst->progress.deaths)
+            reward -= 1, done = true;
+        if (progress.level == 30)
+            done = true;
+        if (++inst->steps == env->max_steps)
+            done = true;
+        inst->progress = progress;
+
+        rewards[i] = reward;
+        dones[i] = done;
+        if (done)
+            reset_instance(env, i, obs);
+        else
+            observe(env, i, obs);
+    }
+    P8buttons = buttons;
+}
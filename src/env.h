@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+
+// vectorized environment for training agents: a batch of independent game
+// instances stepped together through a plain C ABI (bin/libceleste-env.so).
+//
+// episodes start at the first level. an action is a button mask (bit 0 left,
+// 1 right, 2 up, 3 down, 4 jump, 5 dash). the reward of a step is +1 per level
+// climbed and -1 for a death. an episode is done when the player dies, reaches
+// the summit or runs out of steps; the instance is then reset right away and
+// the observation returned is the first one of the next episode.
+//
+// observations are the palette indices (0-15) of the screen, instance i at
+// obs + i * env_observation_size(). nothing is allocated or copied per step:
+// at full resolution the game draws straight into the caller's buffer, which
+// must then be the same for every step, the game skips drawing on freeze
+// frames and leaves the previous frame in place.
+//
+// an env is stepped by the calling thread. to use several cores, create one
+// env per thread.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CelesteEnv CelesteEnv;
+
+// `data_dir` holds gfx.bmp and font.bmp, they are loaded by the first call and
+// shared by every env. returns NULL on failure
+CelesteEnv *env_create(int n, char const *data_dir);
+
+void env_destroy(CelesteEnv *env);
+
+// observations are downsampled by keeping one pixel out of every
+// `factor`x`factor` block: 1 (128x128, the default), 2 (64x64) or 4 (32x32).
+// returns 0 for an unsupported factor
+int env_set_observation(CelesteEnv *env, int factor);
+
+// bytes of one instance's observation
+size_t env_observation_size(CelesteEnv const *env);
+
+// episode length limit, 0 for none (the default is 9000 steps, five minutes)
+void env_set_max_steps(CelesteEnv *env, int steps);
+
+// starts a new episode in every instance, instance i with rng seed seed + i.
+// the instances reset later on take the following seeds
+void env_reset(CelesteEnv *env, unsigned seed, unsigned char *obs);
+
+// `actions`, `rewards` and `dones` hold one entry per instance
+void env_step(CelesteEnv *env, unsigned char const *actions, unsigned char *obs, float *rewards,
+              unsigned char *dones);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "bands.h"
+#include "celeste.h"
+#include "osd.h"
+#include "p8.h"
+#include "p8gfx.h"
+#include "replay.h"
+#include "tools.h"
+
+// golden frames: plays fixed scenes with fixed inputs, hashes the framebuffer
+// after every Celeste_P8_draw() and osd_draw(), and compares the hashes
+// against the lists recorded by a known good renderer. a renderer change that
+// alters even one pixel of one frame shows up as a mismatch, and the first
+// mismatching frame of each scene is written out as a bmp.
+//
+// the scenes are the title screen and every room: a scene starts by skipping
+// from the title to its room, then mashes buttons seeded by the scene number.
+// the scenes are independent and run in parallel.
+
+#define SCENE_COUNT 32 // the title, then levels 0 to 30
+#define SCENE_FRAMES 150
+#define GOLDEN_VERSION 1
+
+// with -l every frame is recorded as a display list, then played back. with
+// -b n as well, it is played over n bands
+static bool use_dlist = false;
+static int band_count = 1;
+
+static uint64_t hash_frame(unsigned char const *frame) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (int i = 0; i < PICO8_W * PICO8_H; i++)
+        h = (h ^ frame[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static void scene_name(char *out, size_t size, int scene) {
+    if (scene == 0)
+        snprintf(out, size, "title");
+    else
+        snprintf(out, size, "level%02d", scene - 1);
+}
+
+// scenes //
+////////////
+
+typedef struct {
+    uint64_t hashes[SCENE_FRAMES];
+    bool expected;           // checking against golden hashes
+    uint64_t golden[SCENE_FRAMES];
+    int mismatches;
+    int first_mismatch;      // -1 when none
+    bool dumped;
+} SCENE;
+
+static void step(CelesteContext *game, int input) {
+    if (input & REPLAY_SKIP)
+        Celeste_P8__DEBUG(game);
+    P8buttons = input & REPLAY_BUTTONS;
+    Celeste_P8_update(game);
+    Celeste_P8_draw(game);
+}
+
+static void run_scene(SCENE *sc, int scene, char const *dump_dir) {
+    unsigned char frame[PICO8_W * PICO8_H] = {0};
+    P8DLIST list = {0};
+    BANDS *bands = band_count > 1 ? bands_create(band_count) : NULL;
+    p8gfx_screen = frame;
+    p8gfx_pal_reset();
+
+    CelesteContext *game = Celeste_P8_create();
+    Celeste_P8_set_rndseed(game, scene);
+    Celeste_P8_init(game);
+    if (scene > 0) {
+        // skip to the room, waiting while the title screen (level 31) starts
+        // the game
+        CelesteProgress progress;
+        int input = REPLAY_SKIP;
+        for (;;) {
+            step(game, input);
+            Celeste_P8_get_progress(game, &progress);
+            if (progress.level == scene - 1)
+                break;
+            input = progress.level == 31 ? 0 : REPLAY_SKIP;
+        }
+    }
+
+    char name[32];
+    scene_name(name, sizeof name, scene);
+    osd_show(name);
+
+    unsigned input_seed = scene + 1;
+    int input = 0;
+    sc->first_mismatch = -1;
+    for (int f = 0; f < SCENE_FRAMES; f++) {
+        // the title waits a second before starting the game
+        if (scene == 0)
+            input = f >= 30 && f < 34 ? 1 << 4 : 0;
+        else if (f % 8 == 0)
+            input = xorshift32(&input_seed) & 0x3f;
+        if (use_dlist)
+            p8gfx_record(&list);
+        step(game, input);
+        osd_draw();
+        if (use_dlist) {
+            p8gfx_record(NULL);
+            if (bands)
+                bands_play(bands, &list, frame);
+            else
+                p8gfx_play(&list);
+        }
+
+        sc->hashes[f] = hash_frame(frame);
+        if (sc->expected && sc->hashes[f] != sc->golden[f]) {
+            if (sc->mismatches++ == 0) {
+                sc->first_mismatch = f;
+                char path[4096];
+                snprintf(path, sizeof path, "%s/golden-%s-%03d.bmp", dump_dir, name, f);
+                P8SURFACE s = {PICO8_W, PICO8_H, frame};
+                sc->dumped = p8gfx_save_bmp(path, &s);
+            }
+        }
+    }
+    Celeste_P8_destroy(game);
+    p8gfx_dlist_free(&list);
+    if (bands)
+        bands_destroy(bands);
+    p8gfx_screen = NULL;
+}
+
+// golden file //
+/////////////////
+
+// text: a "celeste golden frames <version>" line, then for every scene a
+// "<name> <frames>" line followed by the hash of each frame in hex
+
+static bool save_golden(char const *path, SCENE const *scenes) {
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    fprintf(f, "celeste golden frames %d\n", GOLDEN_VERSION);
+    for (int s = 0; s < SCENE_COUNT; s++) {
+        char name[32];
+        scene_name(name, sizeof name, s);
+        fprintf(f, "%s %d\n", name, SCENE_FRAMES);
+        for (int i = 0; i < SCENE_FRAMES; i++)
+            fprintf(f, "%016llx\n", (unsigned long long)scenes[s].hashes[i]);
+    }
+    return fclose(f) == 0;
+}
+
+static bool load_golden(char const *path, SCENE *scenes) {
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    int version = 0;
+    bool ok = fscanf(f, "celeste golden frames %d", &version) == 1 && version == GOLDEN_VERSION;
+    for (int s = 0; ok && s < SCENE_COUNT; s++) {
+        char name[32], read[32];
+        int frames = 0;
+        scene_name(name, sizeof name, s);
+        ok = fscanf(f, "%31s %d", read, &frames) == 2 && !strcmp(name, read) && frames == SCENE_FRAMES;
+        for (int i = 0; ok && i < SCENE_FRAMES; i++) {
+            unsigned long long h;
+            ok = fscanf(f, "%llx", &h) == 1;
+            scenes[s].golden[i] = h;
+        }
+        scenes[s].expected = true;
+    }
+    fclose(f);
+    return ok;
+}
+
+static void usage(char const *prog) {
+    fprintf(stderr, "usage: %s [-c golden | -w golden] [-d data_dir] [-o dump_dir] [-j threads] [-l] [-b bands]\n", prog);
+    fprintf(stderr, "  -c golden  compare every frame against the golden hashes (default: data/golden.txt)\n");
+    fprintf(stderr, "  -w golden  record the golden hashes\n");
+    fprintf(stderr, "  -d dir     directory of gfx.bmp and font.bmp (default: data)\n");
+    fprintf(stderr, "  -o dir     where the mismatching frames are written (default: .)\n");
+    fprintf(stderr, "  -j threads threads to spread the scenes over (default: one per core)\n");
+    fprintf(stderr, "  -l         draw through display lists\n");
+    fprintf(stderr, "  -b bands   draw through display lists, played over that many bands\n");
+}
+
+int main(int argc, char **argv) {
+    char const *golden_path = "data/golden.txt";
+    char const *data_dir = "data";
+    char const *dump_dir = ".";
+    bool record = false;
+    int threads = (int)std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        if ((!strcmp(argv[i], "-c") || !strcmp(argv[i], "-w")) && i + 1 < argc) {
+            record = argv[i][1] == 'w';
+            golden_path = argv[++i];
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            dump_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-l")) {
+            use_dlist = true;
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            use_dlist = true;
+            band_count = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+
+    if (!p8gfx_load_sheets(data_dir)) {
+        fprintf(stderr, "%s: could not load the sprite sheets from '%s'\n", argv[0], data_dir);
+        return 1;
+    }
+
+    std::vector<SCENE> scenes(SCENE_COUNT);
+    if (!record && !load_golden(golden_path, scenes.data())) {
+        fprintf(stderr, "%s: could not load golden frames '%s'\n", argv[0], golden_path);
+        return 1;
+    }
+
+    // the threads take the next scene not yet run
+    double start = now_seconds();
+    std::atomic<int> next(0);
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads && t < SCENE_COUNT; t++) {
+        pool.emplace_back([&] {
+            for (int s; (s = next++) < SCENE_COUNT;)
+                run_scene(&scenes[s], s, dump_dir);
+        });
+    }
+    for (std::thread &th : pool)
+        th.join();
+    double elapsed = now_seconds() - start;
+
+    if (record) {
+        if (!save_golden(golden_path, scenes.data())) {
+            fprintf(stderr, "%s: could not write golden frames '%s'\n", argv[0], golden_path);
+            return 1;
+        }
+        printf("%d scenes, %d frames recorded in %.3f s\n", SCENE_COUNT, SCENE_COUNT * SCENE_FRAMES, elapsed);
+        return 0;
+    }
+
+    int failed = 0;
+    for (int s = 0; s < SCENE_COUNT; s++) {
+        SCENE const *sc = &scenes[s];
+        if (!sc->mismatches)
+            continue;
+        char name[32];
+        scene_name(name, sizeof name, s);
+        printf("%s: %d of %d frames differ, first at frame %d", name, sc->mismatches, SCENE_FRAMES, sc->first_mismatch);
+        if (sc->dumped)
+            printf(" (%s/golden-%s-%03d.bmp)", dump_dir, name, sc->first_mismatch);
+        printf("\n");
+        failed++;
+    }
+    printf("%d scenes, %d frames checked in %.3f s: %s\n", SCENE_COUNT, SCENE_COUNT * SCENE_FRAMES, elapsed,
+           failed ? "mismatch" : "all identical");
+    return failed ? 2 : 0;
+}
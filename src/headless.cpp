@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <vector>
+
+#include "celeste.h"
+#include "p8.h"
+#include "replay.h"
+#include "rewind.h"
+#include "tools.h"
+
+// headless runner: steps the game as fast as possible, without a window,
+// audio or frame pacing. used for validation runs and to measure how fast
+// the simulation itself is.
+
+// fingerprint sidecar: "CCFP", u32 version, u32 component count, then the
+// component hashes of every frame (see Celeste_P8_hash_state), all little
+// endian
+#define FINGERPRINT_VERSION 1
+
+static void put_le(unsigned char *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_le(unsigned char const *p, int n) {
+    uint64_t v = 0;
+    for (int i = 0; i < n; i++)
+        v |= (uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static FILE *open_fingerprints(char const *path, bool write) {
+    unsigned char header[12] = {'C', 'C', 'F', 'P'};
+    FILE *f = fopen(path, write ? "wb" : "rb");
+    if (!f)
+        return NULL;
+    if (write) {
+        put_le(header + 4, FINGERPRINT_VERSION, 4);
+        put_le(header + 8, CELESTE_P8_HASH_COUNT, 4);
+        if (fwrite(header, sizeof header, 1, f) == 1)
+            return f;
+    } else if (fread(header, sizeof header, 1, f) == 1 && !memcmp(header, "CCFP", 4) &&
+               get_le(header + 4, 4) == FINGERPRINT_VERSION && get_le(header + 8, 4) == CELESTE_P8_HASH_COUNT) {
+        return f;
+    }
+    fclose(f);
+    return NULL;
+}
+
+// multi-instance runner: every instance is a separate CelesteContext mashing
+// its own random inputs, instance k seeded with seed+k. each thread steps a
+// contiguous share of the instances, one frame of each in turn.
+typedef struct {
+    CelesteContext *game;
+    unsigned input_seed;
+} INSTANCE;
+
+static void run_instances(INSTANCE *instances, int count, long frames) {
+    for (long f = 0; f < frames; f++) {
+        for (int i = 0; i < count; i++) {
+            INSTANCE *inst = &instances[i];
+            if (f % 8 == 0)
+                P8buttons = xorshift32(&inst->input_seed) & REPLAY_BUTTONS;
+            else
+                P8buttons = inst->input_seed & REPLAY_BUTTONS;
+            Celeste_P8_update(inst->game);
+            Celeste_P8_draw(inst->game);
+        }
+    }
+}
+
+static int run_parallel(int count, int threads, long frames, unsigned seed) {
+    std::vector<INSTANCE> instances(count);
+    for (int i = 0; i < count; i++) {
+        instances[i].game = Celeste_P8_create();
+        if (!instances[i].game) {
+            fprintf(stderr, "could not create instance %d\n", i);
+            return 1;
+        }
+        Celeste_P8_set_rndseed(instances[i].game, seed + i);
+        instances[i].input_seed = seed + i ? seed + i : 1;
+        Celeste_P8_init(instances[i].game);
+    }
+    if (threads > count)
+        threads = count;
+
+    double start = now_seconds();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) {
+        int first = count * t / threads, last = count * (t + 1) / threads;
+        pool.emplace_back(run_instances, &instances[first], last - first, frames);
+    }
+    for (std::thread &th : pool)
+        th.join();
+    double elapsed = now_seconds() - start;
+
+    // combined fingerprint of the final states, the same for any thread count
+    uint64_t check = 0;
+    for (INSTANCE &inst : instances) {
+        uint64_t hashes[CELESTE_P8_HASH_COUNT];
+        Celeste_P8_hash_state(inst.game, hashes);
+        for (int i = 0; i < CELESTE_P8_HASH_COUNT; i++)
+            check = (check ^ hashes[i]) * 0x100000001b3ull;
+        Celeste_P8_destroy(inst.game);
+    }
+
+    long total = frames * count;
+    printf("%d instances on %d threads, %ld frames in %.3f s: %.0f frames/sec, state %016llx\n", count, threads, total,
+           elapsed, elapsed > 0 ? total / elapsed : 0, (unsigned long long)check);
+    return 0;
+}
+
+static void usage(char const *prog) {
+    fprintf(stderr, "usage: %s [-n frames] [-s seed] [-r] [-p replay | -w replay] [-f sidecar | -c sidecar]\n", prog);
+    fprintf(stderr, "       %s -i instances [-j threads] [-n frames] [-s seed]\n", prog);
+    fprintf(stderr, "  -n frames  number of frames to simulate (default: 100000, or the whole replay)\n");
+    fprintf(stderr, "  -s seed    seed for the game rng and the random inputs (default: 1)\n");
+    fprintf(stderr, "  -r         capture rewind snapshots every frame and report their cost\n");
+    fprintf(stderr, "  -p replay  play back a replay instead of random inputs\n");
+    fprintf(stderr, "  -w replay  record the random inputs to a replay\n");
+    fprintf(stderr, "  -f sidecar write the fingerprint of every frame\n");
+    fprintf(stderr, "  -c sidecar compare every frame against the fingerprints, report the first desync\n");
+    fprintf(stderr, "  -i count   step `count` independent instances with random inputs\n");
+    fprintf(stderr, "  -j threads threads to spread the instances over (default: one per core)\n");
+}
+
+int main(int argc, char **argv) {
+    long frames = -1;
+    unsigned seed = 1;
+    bool rewind = false;
+    char const *play_path = NULL;
+    char const *record_path = NULL;
+    char const *fingerprint_path = NULL;
+    bool check = false;
+    int instances = 0;
+    int threads = (int)std::thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            frames = strtol(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-r")) {
+            rewind = true;
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            play_path = argv[++i];
+        } else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            record_path = argv[++i];
+        } else if ((!strcmp(argv[i], "-f") || !strcmp(argv[i], "-c")) && i + 1 < argc) {
+            check = argv[i][1] == 'c';
+            fingerprint_path = argv[++i];
+        } else if (!strcmp(argv[i], "-i") && i + 1 < argc) {
+            instances = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (instances) {
+        if (instances < 0 || rewind || play_path || record_path || fingerprint_path) {
+            usage(argv[0]);
+            return 1;
+        }
+        return run_parallel(instances, threads > 0 ? threads : 1, frames < 0 ? 100000 : frames, seed);
+    }
+
+    REPLAY replay = {0};
+    if (play_path) {
+        if (!replay_load(&replay, play_path)) {
+            fprintf(stderr, "%s: could not load replay '%s'\n", argv[0], play_path);
+            return 1;
+        }
+        seed = replay.seed;
+        if (frames < 0 || frames > replay.frames)
+            frames = replay.frames;
+    } else if (frames < 0) {
+        frames = 100000;
+    }
+
+    FILE *fingerprints = NULL;
+    if (fingerprint_path && !(fingerprints = open_fingerprints(fingerprint_path, !check))) {
+        fprintf(stderr, "%s: could not open fingerprints '%s'\n", argv[0], fingerprint_path);
+        return 1;
+    }
+    long desync = -1;
+
+    p8gfx_screen = NULL; // nothing is displayed, drawing calls are no-ops
+    CelesteContext *game = Celeste_P8_create();
+    Celeste_P8_set_rndseed(game, seed);
+    unsigned input_seed = seed ? seed : 1;
+
+    // replays reset to the state right after seeding
+    void *initial_state = malloc(Celeste_P8_get_state_size());
+    Celeste_P8_save_state(game, initial_state);
+
+    Celeste_P8_init(game);
+    if (record_path)
+        replay_record_start(&replay, seed);
+
+    // same settings as the sdl frontend
+    REWIND *rw = NULL;
+    void *rewind_state = NULL;
+    if (rewind) {
+        rw = rewind_create(Celeste_P8_get_state_size(), 30 * 60 * 3, 30);
+        rewind_state = malloc(Celeste_P8_get_state_size());
+    }
+    double capture = 0;
+
+    double start = now_seconds();
+    int input = 0;
+    for (long f = 0; f < frames; f++) {
+        if (play_path) {
+            if (!replay_next(&replay, &input)) {
+                frames = f;
+                break;
+            }
+        } else if (f % 8 == 0) {
+            // mash buttons, holding each combination for a few frames
+            input = xorshift32(&input_seed) & REPLAY_BUTTONS;
+        }
+        if (record_path)
+            replay_record(&replay, input);
+
+        if (input & REPLAY_RESET) {
+            Celeste_P8_load_state(game, initial_state);
+            Celeste_P8_init(game);
+        }
+        if (input & REPLAY_SKIP)
+            Celeste_P8__DEBUG(game);
+        P8buttons = input & REPLAY_BUTTONS;
+        Celeste_P8_update(game);
+        if (rw) {
+            double t = now_seconds();
+            Celeste_P8_save_state(game, rewind_state);
+            rewind_push(rw, rewind_state);
+            capture += now_seconds() - t;
+        }
+        Celeste_P8_draw(game);
+
+        if (fingerprints) {
+            uint64_t hashes[CELESTE_P8_HASH_COUNT];
+            unsigned char record[sizeof hashes];
+            Celeste_P8_hash_state(game, hashes);
+            if (!check) {
+                for (int i = 0; i < CELESTE_P8_HASH_COUNT; i++)
+                    put_le(record + 8 * i, hashes[i], 8);
+                fwrite(record, sizeof record, 1, fingerprints);
+            } else if (fread(record, sizeof record, 1, fingerprints) != 1) {
+                printf("fingerprints end at frame %ld\n", f);
+                fclose(fingerprints);
+                fingerprints = NULL;
+            } else {
+                for (int i = 0; i < CELESTE_P8_HASH_COUNT; i++) {
+                    if (get_le(record + 8 * i, 8) != hashes[i]) {
+                        printf("desync at frame %ld: %s\n", f, Celeste_P8_hash_name(i));
+                        desync = f;
+                    }
+                }
+                if (desync >= 0) {
+                    frames = f + 1;
+                    break;
+                }
+            }
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%ld frames in %.3f s: %.0f frames/sec\n", frames, elapsed, elapsed > 0 ? frames / elapsed : 0);
+    if (rw && frames > 0) {
+        // the cost of one capture against the 33.3 ms of a 30 fps frame
+        double per_frame = capture / frames;
+        long held = rewind_count(rw);
+        printf("rewind: %.2f us/capture (%.4f%% of a frame), %.0f KB per minute, %ld frames held in %.0f KB\n",
+               per_frame * 1e6, per_frame * 30 * 100, (double)rewind_size(rw) / held * 30 * 60 / 1024,
+               held, rewind_size(rw) / 1024.0);
+        rewind_destroy(rw);
+        free(rewind_state);
+    }
+    if (record_path) {
+        if (!replay_save(&replay, record_path)) {
+            fprintf(stderr, "%s: could not write replay '%s'\n", argv[0], record_path);
+            return 1;
+        }
+        printf("replay: %ld frames in %zu bytes\n", replay.frames, replay.size + 16);
+    }
+    if (fingerprints && fclose(fingerprints) != 0) {
+        fprintf(stderr, "%s: could not write fingerprints '%s'\n", argv[0], fingerprint_path);
+        return 1;
+    }
+    if (check && desync < 0)
+        printf("no desync in %ld frames\n", frames);
+    replay_free(&replay);
+    free(initial_state);
+    Celeste_P8_destroy(game);
+    return desync >= 0 ? 2 : 0;
+}
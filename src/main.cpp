@@ -10,8 +10,16 @@
 
 #include <SDL_mixer.h>
 
+#include "bands.h"
 #include "celeste.h"
 #include "p8.h"
+#include "osd.h"
+#include "p8gfx.h"
+#include "pacer.h"
+#include "render.h"
+#include "replay.h"
+#include "rewind.h"
+#include "timing.h"
 #include "sdl20compat.inc.c"
 
 static void ErrLog(char *fmt, ...) {
@@ -26,27 +34,23 @@ static void ErrLog(char *fmt, ...) {
 }
 
 SDL_Surface *screen = NULL;
-SDL_Surface *gfx = NULL;
-SDL_Surface *font = NULL;
+P8SURFACE gfx = {0};
+P8SURFACE font = {0};
 Mix_Chunk *snd[64] = {NULL};
 Mix_Music *mus[6] = {NULL};
 
-#define PICO8_W 128
-#define PICO8_H 128
-
 static int scale = 4;
 static SDL_Color const base_palette[16] = {
     {0x00, 0x00, 0x00}, {0x1d, 0x2b, 0x53}, {0x7e, 0x25, 0x53}, {0x00, 0x87, 0x51}, {0xab, 0x52, 0x36}, {0x5f, 0x57, 0x4f}, {0xc2, 0xc3, 0xc7}, {0xff, 0xf1, 0xe8}, {0xff, 0x00, 0x4d}, {0xff, 0xa3, 0x00}, {0xff, 0xec, 0x27}, {0x00, 0xe4, 0x36}, {0x29, 0xad, 0xff}, {0x83, 0x76, 0x9c}, {0xff, 0x77, 0xa8}, {0xff, 0xcc, 0xaa}
 };
-static SDL_Color palette[16];
-
-static inline Uint32 getcolor(char idx) {
-    SDL_Color c = palette[idx % 16];
-    return SDL_MapRGB(screen->format, c.r, c.g, c.b);
-}
+// rgb value of each palette index in the screen format, used when presenting
+static Uint32 screen_lut[16];
 
-static void ResetPalette(void) {
-    memcpy(palette, base_palette, sizeof palette);
+static void InitScreenLut(void) {
+    for (int i = 0; i < 16; i++) {
+        SDL_Color c = base_palette[i];
+        screen_lut[i] = SDL_MapRGB(screen->format, c.r, c.g, c.b);
+    }
 }
 
 static char *GetDataPath(char *path, int n, char const *fname) {
@@ -112,10 +116,9 @@ void putpixel(SDL_Surface *surface, int x, int y, Uint32 pixel) {
     }
 }
 
-static void loadbmpscale(char *filename, SDL_Surface **s) {
-    SDL_Surface *surf = *s;
-    if (surf)
-        SDL_FreeSurface(surf), surf = *s = NULL;
+static void loadbmp(char *filename, P8SURFACE *s) {
+    if (s->pixels)
+        free(s->pixels), s->pixels = NULL;
 
     char tmpath[4096];
     SDL_Surface *bmp = SDL_LoadBMP(GetDataPath(tmpath, sizeof tmpath, filename));
@@ -126,23 +129,14 @@ static void loadbmpscale(char *filename, SDL_Surface **s) {
 
     int w = bmp->w, h = bmp->h;
 
-    surf =
-        SDL_CreateRGBSurface(SDL_SWSURFACE, w * scale, h * scale, 8, 0, 0, 0, 0);
-    assert(surf != NULL);
-    unsigned char *data = (unsigned char *)surf->pixels;
-    /*memcpy((_S)->format->palette->colors, base_palette, 16*sizeof(SDL_Color));*/
+    unsigned char *data = (unsigned char *)malloc(w * h);
+    assert(data != NULL);
     for (int y = 0; y < h; y++)
         for (int x = 0; x < w; x++) {
-            unsigned char pix = getpixel(bmp, x, y);
-            for (int i = 0; i < scale; i++)
-                for (int j = 0; j < scale; j++) {
-                    data[x * scale + i + (y * scale + j) * w * scale] = pix;
-                }
+            data[x + y * w] = getpixel(bmp, x, y);
         }
     SDL_FreeSurface(bmp);
-    SDL_SetColorKey(surf, SDL_SRCCOLORKEY, 0);
-    // SDL_SaveBMP(_S, #_S "x.bmp");
-    *s = surf;
+    *s = (P8SURFACE){.w = w, .h = h, .pixels = data};
 }
 
 #define LOGLOAD(w) printf("loading %s...", w)
@@ -150,13 +144,15 @@ static void loadbmpscale(char *filename, SDL_Surface **s) {
 
 static void LoadData(void) {
     LOGLOAD("gfx.bmp");
-    loadbmpscale("gfx.bmp", &gfx);
+    loadbmp("gfx.bmp", &gfx);
     LOGDONE();
 
     LOGLOAD("font.bmp");
-    loadbmpscale("font.bmp", &font);
+    loadbmp("font.bmp", &font);
     LOGDONE();
 
+    p8gfx_set_sheets(&gfx, &font);
+
     static char const sndids[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 14, 15, 16, 23, 35, 37, 38, 40, 50, 51, 54, 55};
     for (int iid = 0; iid < sizeof sndids; iid++) {
         int id = sndids[iid];
@@ -186,8 +182,6 @@ static void LoadData(void) {
         LOGDONE();
     }
 }
-#include "../data/map.inc"
-
 static Uint16 buttons_state = 0;
 
 #define SDL_CHECK(r)                                                                            \
@@ -198,34 +192,15 @@ static Uint16 buttons_state = 0;
         }                                                                                       \
     } while (0)
 
-static void p8_rectfill(int x0, int y0, int x1, int y1, int col);
-static void p8_print(char const *str, int x, int y, int col);
-
-// on-screen display (for info, such as loading a state, toggling screenshake,
-// toggling fullscreen, etc)
-static char osd_text[200] = "";
-static int osd_timer = 0;
+// shows a message on screen, and on stdout
 static void OSDset(char const *fmt, ...) {
+    char text[200];
     va_list ap;
     va_start(ap, fmt);
-    vsnprintf(osd_text, sizeof osd_text, fmt, ap);
-    osd_text[sizeof osd_text - 1] =
-        '\0'; // make sure to add NUL terminator in case of truncation
-    printf("%s\n", osd_text);
-    osd_timer = 30;
+    vsnprintf(text, sizeof text, fmt, ap);
     va_end(ap);
-}
-static void OSDdraw(void) {
-    if (osd_timer > 0) {
-        --osd_timer;
-        int const x = 4;
-        int const y =
-            120 + (osd_timer < 10 ? 10 - osd_timer
-                                  : 0);                                // disappear by going below the screen
-        p8_rectfill(x - 2, y - 2, x + 4 * strlen(osd_text), y + 6, 6); // outline
-        p8_rectfill(x - 1, y - 1, x + 4 * strlen(osd_text) - 1, y + 5, 0);
-        p8_print(osd_text, x, y, 7);
-    }
+    printf("%s\n", text);
+    osd_show(text);
 }
 
 static Mix_Music *current_music = NULL;
@@ -233,18 +208,149 @@ static bool enable_screenshake = 1;
 static bool paused = 0;
 
 static bool running = 1;
+static CelesteContext *game = NULL;
+static unsigned char screen_pixels[PICO8_W * PICO8_H];
 static void *initial_game_state = NULL;
 static void *game_state = NULL;
-static Mix_Music *game_state_music = NULL;
 static void mainLoop(void);
 
+// hold r to rewind, through the last 3 minutes of play
+static REWIND *rewind_buffer = NULL;
+static void *rewind_state = NULL;
+
+// 30 fps frame pacing, on vsync unless turned off with -novsync
+static PACER pacer;
+static bool use_vsync = true;
+
+// with -renderthread the frames are rasterized on a thread of their own,
+// shown one frame later
+static bool use_render_thread = false;
+
+// with -bands n the frames are recorded, then rasterized and scaled up by n
+// threads, each over a band of the screen
+static int band_count = 1;
+static BANDS *bands = NULL;
+static P8DLIST band_list; // without the render thread
+
+// input replays, recorded with -record <file> and played back with
+// -play <file>. hold tab to play back uncapped
+static REPLAY replay = {0};
+static char const *replay_record_path = NULL;
+static bool replay_playing = false;
+static int pending_events = 0; // REPLAY_SKIP/REPLAY_RESET for the next update
+
+// ends recording (saving what was recorded) or playback, for when the game
+// state is changed by something the replay cannot hold
+static void EndReplay(void) {
+    if (replay_record_path) {
+        if (replay_save(&replay, replay_record_path))
+            OSDset("replay saved to %s", replay_record_path);
+        else
+            ErrLog("error writing replay '%s': %s\n", replay_record_path, strerror(errno));
+        replay_record_path = NULL;
+    }
+    if (replay_playing) {
+        replay_playing = false;
+        OSDset("replay ended");
+    }
+}
+
+// quick-save slots: F5 saves the game state into the current slot and F6
+// loads it back, 1-4 select the slot. slots are kept on disk so that they
+// survive a restart
+static int save_slot = 1;
+
+typedef struct {
+    char magic[4];  // "CCSV"
+    Uint32 version; // CELESTE_P8_STATE_VERSION
+    Uint32 size;    // Celeste_P8_get_state_size()
+} SAVE_HEADER;
+
+static char *GetSlotPath(char *path, int n, int slot) {
+    snprintf(path, n, "celeste-slot%i.sav", slot);
+    return path;
+}
+
+static void SaveState(void) {
+    size_t size = Celeste_P8_get_state_size();
+    if (!game_state && !(game_state = SDL_malloc(size)))
+        return;
+    Celeste_P8_save_state(game, game_state);
+
+    char path[64];
+    GetSlotPath(path, sizeof path, save_slot);
+    SAVE_HEADER header = {{'C', 'C', 'S', 'V'}, CELESTE_P8_STATE_VERSION, (Uint32)size};
+    FILE *f = fopen(path, "wb");
+    if (!f || fwrite(&header, sizeof header, 1, f) != 1 || fwrite(game_state, size, 1, f) != 1) {
+        ErrLog("error writing '%s': %s\n", path, strerror(errno));
+        OSDset("could not save state %i", save_slot);
+    } else {
+        OSDset("saved state %i", save_slot);
+    }
+    if (f)
+        fclose(f);
+}
+
+static void LoadState(void) {
+    size_t size = Celeste_P8_get_state_size();
+    if (!game_state && !(game_state = SDL_malloc(size)))
+        return;
+
+    char path[64];
+    GetSlotPath(path, sizeof path, save_slot);
+    SAVE_HEADER header;
+    FILE *f = fopen(path, "rb");
+    bool ok = f && fread(&header, sizeof header, 1, f) == 1;
+    if (!ok) {
+        OSDset("no state in slot %i", save_slot);
+    } else if (memcmp(header.magic, "CCSV", 4) || header.version != CELESTE_P8_STATE_VERSION || header.size != size) {
+        OSDset("state %i is from another version", save_slot);
+        ok = false;
+    } else if (fread(game_state, size, 1, f) != 1) {
+        OSDset("state %i is truncated", save_slot);
+        ok = false;
+    }
+    if (f)
+        fclose(f);
+    if (!ok)
+        return;
+
+    EndReplay();
+    Mix_HaltChannel(-1);
+    Celeste_P8_load_state(game, game_state);
+    OSDset("loaded state %i", save_slot);
+}
+
 int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-record") && i + 1 < argc) {
+            replay_record_path = argv[++i];
+        } else if (!strcmp(argv[i], "-play") && i + 1 < argc) {
+            if (!replay_load(&replay, argv[++i])) {
+                ErrLog("could not load replay '%s'\n", argv[i]);
+                return 1;
+            }
+            replay_playing = true;
+        } else if (!strcmp(argv[i], "-novsync")) {
+            use_vsync = false;
+        } else if (!strcmp(argv[i], "-renderthread")) {
+            use_render_thread = true;
+        } else if (!strcmp(argv[i], "-bands") && i + 1 < argc) {
+            band_count = atoi(argv[++i]);
+        } else {
+            ErrLog("usage: %s [-record replay | -play replay] [-novsync] [-renderthread] [-bands n]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (replay_playing)
+        replay_record_path = NULL;
+
     SDL_CHECK(SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) == 0);
     SDL_InitSubSystem(SDL_INIT_GAMECONTROLLER);
     SDL_GameControllerAddMappingsFromRW(
         SDL_RWFromFile("gamecontrollerdb.txt", "rb"), 1
     );
-    int videoflag = SDL_SWSURFACE | SDL_HWPALETTE;
+    int videoflag = SDL_SWSURFACE | SDL_HWPALETTE | (use_vsync ? SDL_DOUBLEBUF : 0);
     SDL_CHECK(screen = SDL_SetVideoMode(PICO8_W * scale, PICO8_H * scale, 32, videoflag));
     SDL_WM_SetCaption("Celeste", NULL);
     int mixflag = MIX_INIT_OGG;
@@ -254,7 +360,8 @@ int main(int argc, char **argv) {
     if (Mix_OpenAudio(22050, AUDIO_S16SYS, 1, 1024) < 0) {
         ErrLog("Mix_Init: %s\n", Mix_GetError());
     }
-    ResetPalette();
+    InitScreenLut();
+    p8gfx_screen = screen_pixels;
     SDL_ShowCursor(0);
 
     printf("now loading...\n");
@@ -295,26 +402,74 @@ skip_load:
 
     LoadData();
 
-    int pico8emu(P8 call, ...);
-    P8bind(pico8emu);
-
     // for reset
-    P8srand((unsigned)(time(NULL) + SDL_GetTicks()));
-
-    Celeste_P8_init();
+    unsigned seed = replay_playing ? replay.seed : (unsigned)(time(NULL) + SDL_GetTicks());
+    SDL_CHECK(game = Celeste_P8_create());
+    Celeste_P8_set_rndseed(game, seed);
+    if (replay_record_path)
+        replay_record_start(&replay, seed);
+    initial_game_state = SDL_malloc(Celeste_P8_get_state_size());
+    if (initial_game_state)
+        Celeste_P8_save_state(game, initial_game_state);
+
+    Celeste_P8_init(game);
+
+    rewind_buffer = rewind_create(Celeste_P8_get_state_size(), 30 * 60 * 3, 30);
+    rewind_state = SDL_malloc(Celeste_P8_get_state_size());
+
+    // present on vsync when the display's refresh rate is known, otherwise
+    // the pacer waits on its own
+    SDL_DisplayMode mode;
+    int refresh_rate = 0;
+    if (use_vsync && SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(sdl2_window), &mode) == 0)
+        refresh_rate = mode.refresh_rate;
+    pacer_init(&pacer, 30, refresh_rate);
+    if (pacer_vsync(&pacer))
+        printf("vsync at %i Hz\n", refresh_rate);
+
+    if (use_render_thread && !render_start(band_count)) {
+        ErrLog("could not start the render thread\n");
+        use_render_thread = false;
+    }
+    if (band_count > 1) {
+        bands = bands_create(band_count);
+        if (!use_render_thread)
+            p8gfx_record(&band_list);
+    }
 
     printf("ready\n");
 
     while (running)
         mainLoop();
 
+    if (use_render_thread)
+        render_stop();
+    if (bands) {
+        p8gfx_record(NULL);
+        p8gfx_dlist_free(&band_list);
+        bands_destroy(bands);
+    }
+
+    PACER_STATS stats;
+    pacer_stats(&pacer, &stats);
+    printf("frame pacing (%s): %ld frames, mean %.3f ms, stddev %.3f ms, p99 jitter %.3f ms, max %.3f ms\n",
+           pacer_vsync(&pacer) ? "vsync" : "sleep+spin", stats.frames, stats.mean, stats.stddev, stats.p99_jitter,
+           stats.max_jitter);
+
+    EndReplay();
+    replay_free(&replay);
+
     if (game_state)
         SDL_free(game_state);
     if (initial_game_state)
         SDL_free(initial_game_state);
+    if (rewind_state)
+        SDL_free(rewind_state);
+    rewind_destroy(rewind_buffer);
+    Celeste_P8_destroy(game);
 
-    SDL_FreeSurface(gfx);
-    SDL_FreeSurface(font);
+    free(gfx.pixels);
+    free(font.pixels);
     for (int i = 0; i < (sizeof snd) / (sizeof *snd); i++) {
         if (snd[i])
             Mix_FreeChunk(snd[i]);
@@ -340,21 +495,70 @@ enum {
 
 static Uint16 const stick_deadzone = 32767 / 2; // about half
 
+// one game frame: the pause screen, a step back in time or an update
+static void RunFrame(Uint8 const *kbstate) {
+    if (paused) {
+        int const x0 = PICO8_W / 2 - 3 * 4, y0 = 8;
+
+        p8gfx_rectfill(x0 - 1, y0 - 1, 6 * 4 + x0 + 1, 6 + y0 + 1, 6);
+        p8gfx_rectfill(x0, y0, 6 * 4 + x0, 6 + y0, 0);
+        p8gfx_print("paused", x0 + 1, y0 + 1, 7);
+        timing_mark(TIMING_DRAW);
+    } else if (kbstate[SDL_SCANCODE_R] && rewind_buffer && rewind_state) {
+        EndReplay();
+        // snapshots are taken between update and draw, so drawing a restored
+        // one redraws that frame exactly
+        if (rewind_pop(rewind_buffer, rewind_state))
+            Celeste_P8_load_state(game, rewind_state);
+        timing_mark(TIMING_UPDATE);
+        Celeste_P8_draw(game);
+        timing_mark(TIMING_DRAW);
+    } else {
+        int input = (buttons_state & REPLAY_BUTTONS) | pending_events;
+        pending_events = 0;
+        if (replay_playing && !replay_next(&replay, &input))
+            EndReplay();
+        if (replay_record_path)
+            replay_record(&replay, input);
+
+        if (input & REPLAY_RESET) {
+            Celeste_P8_load_state(game, initial_game_state);
+            Celeste_P8_init(game);
+            if (rewind_buffer)
+                rewind_clear(rewind_buffer);
+        }
+        if (input & REPLAY_SKIP)
+            Celeste_P8__DEBUG(game);
+        P8buttons = input & REPLAY_BUTTONS;
+        Celeste_P8_update(game);
+        if (rewind_buffer && rewind_state) {
+            Celeste_P8_save_state(game, rewind_state);
+            rewind_push(rewind_buffer, rewind_state);
+        }
+        timing_mark(TIMING_UPDATE);
+        Celeste_P8_draw(game);
+        timing_mark(TIMING_DRAW);
+    }
+}
+
 static void mainLoop(void) {
     Uint8 const *kbstate = SDL_GetKeyboardState(NULL);
+    // game frames to run before presenting, none while waiting for vsync
+    bool fast_forward = replay_playing && kbstate[SDL_SCANCODE_TAB];
+    int frames = fast_forward ? 4 : pacer_frames(&pacer);
 
     static int reset_input_timer = 0;
     // hold F9 (select+start+y) to reset
     if (initial_game_state != NULL && kbstate[SDL_SCANCODE_F9]) {
-        reset_input_timer++;
+        reset_input_timer += frames;
         if (reset_input_timer >= 30) {
             reset_input_timer = 0;
-            // reset
+            // reset, done by the next update
             OSDset("reset");
             paused = 0;
             Mix_HaltChannel(-1);
             Mix_HaltMusic();
-            Celeste_P8_init();
+            pending_events |= REPLAY_RESET;
         }
     } else
         reset_input_timer = 0;
@@ -400,14 +604,26 @@ static void mainLoop(void) {
                        !(kbstate[SDL_SCANCODE_LSHIFT] || kbstate[SDL_SCANCODE_ESCAPE])) {
                 screen = SDL_GetVideoSurface();
                 break;
+            } else if (ev.key.keysym.scancode >= SDL_SCANCODE_1 && ev.key.keysym.scancode <= SDL_SCANCODE_4) {
+                save_slot = ev.key.keysym.scancode - SDL_SCANCODE_1 + 1;
+                OSDset("slot %i", save_slot);
+                break;
             } else if (ev.key.keysym.scancode == SDL_SCANCODE_5) {
-                Celeste_P8__DEBUG();
+                pending_events |= REPLAY_SKIP;
                 break;
             } else if ( // toggle screenshake (e / L+R)
                 ev.key.keysym.scancode == SDL_SCANCODE_E
             ) {
                 enable_screenshake = !enable_screenshake;
+                P8camera_enable(enable_screenshake);
                 OSDset("screenshake: %s", enable_screenshake ? "on" : "off");
+            } else if (ev.key.keysym.scancode == SDL_SCANCODE_F7) { // frame pacing stats
+                PACER_STATS stats;
+                pacer_stats(&pacer, &stats);
+                OSDset("p99 jitter %.2fms, sd %.2fms", stats.p99_jitter, stats.stddev);
+            } else if (ev.key.keysym.scancode == SDL_SCANCODE_F8) { // phase timings
+                timing_enable(!timing_enabled);
+                OSDset("timings: %s", timing_enabled ? "on" : "off");
             }
             break;
         }
@@ -427,433 +643,79 @@ static void mainLoop(void) {
     if (kbstate[SDL_SCANCODE_X] || kbstate[SDL_SCANCODE_V] || kbstate[SDL_SCANCODE_M] ||
         kbstate[SDL_SCANCODE_B])
         buttons_state |= (1 << 5);
+    if (kbstate[SDL_SCANCODE_F5])
+        buttons_state |= (1 << PSEUDO_BTN_SAVE_STATE);
+    if (kbstate[SDL_SCANCODE_F6])
+        buttons_state |= (1 << PSEUDO_BTN_LOAD_STATE);
+
+    if (!((prev_buttons_state >> PSEUDO_BTN_SAVE_STATE) & 1) &&
+        (buttons_state >> PSEUDO_BTN_SAVE_STATE) & 1) {
+        SaveState();
+    }
+    if (!((prev_buttons_state >> PSEUDO_BTN_LOAD_STATE) & 1) &&
+        (buttons_state >> PSEUDO_BTN_LOAD_STATE) & 1) {
+        LoadState();
+    }
 
-    if (paused) {
-        int const x0 = PICO8_W / 2 - 3 * 4, y0 = 8;
-
-        p8_rectfill(x0 - 1, y0 - 1, 6 * 4 + x0 + 1, 6 + y0 + 1, 6);
-        p8_rectfill(x0, y0, 6 * 4 + x0, 6 + y0, 0);
-        p8_print("paused", x0 + 1, y0 + 1, 7);
-    } else {
-        Celeste_P8_update();
-        Celeste_P8_draw();
+    timing_mark(TIMING_EVENTS);
+    for (int i = 0; i < frames; i++) {
+        RunFrame(kbstate);
+        osd_draw();
+        timing_mark(TIMING_OSD);
+    }
+    if (frames) {
+        timing_draw();
+        timing_mark(TIMING_OSD);
     }
-    OSDdraw();
 
     /*for (int i = 0 ; i < 16;i++) {
             SDL_Rect rc = {i*8*scale, 0, 8*scale, 4*scale};
             SDL_FillRect(screen, &rc, i);
     }*/
 
-    SDL_Flip(screen);
-
-    static int t = 0;
-    static unsigned frame_start = 0;
-    unsigned frame_end = SDL_GetTicks();
-    unsigned frame_time = frame_end - frame_start;
-    unsigned target_millis;
-    // frame timing for 30fps is 33.333... ms, but we only have integer
-    // granularity so alternate between 33 and 34 ms, like [33,33,34,33,33,34,...]
-    // which averages out to 33.333...
-    if (t < 2)
-        target_millis = 33;
-    else
-        target_millis = 34;
-
-    if (++t == 3)
-        t = 0;
-
-    if (frame_time < target_millis) {
-        SDL_Delay(target_millis - frame_time);
-    }
-    frame_start = SDL_GetTicks();
-}
-
-static int gettileflag(int, int);
-static void p8_line(int, int, int, int, unsigned char);
-
-// lots of code from
-// https://github.com/SDL-mirror/SDL/blob/bc59d0d4a2c814900a506d097a381077b9310509/src/video/SDL_surface.c#L625
-// coordinates should be scaled already
-static inline void Xblit(SDL_Surface *src, SDL_Rect *srcrect, SDL_Surface *dst, SDL_Rect *dstrect, int color, int flipx, int flipy) {
-    assert(src && dst && !src->locked && !dst->locked);
-    assert(dst->format->BitsPerPixel == 32 && src->format->BitsPerPixel == 8);
-    SDL_Rect fulldst;
-    /* If the destination rectangle is NULL, use the entire dest surface */
-    if (!dstrect)
-        dstrect = (fulldst = (SDL_Rect){0, 0, dst->w, dst->h}, &fulldst);
-
-    int srcx, srcy, w, h;
-
-    /* clip the source rectangle to the source surface */
-    if (srcrect) {
-        int maxw, maxh;
-
-        srcx = srcrect->x;
-        w = srcrect->w;
-        if (srcx < 0) {
-            w += srcx;
-            dstrect->x -= srcx;
-            srcx = 0;
-        }
-        maxw = src->w - srcx;
-        if (maxw < w)
-            w = maxw;
-
-        srcy = srcrect->y;
-        h = srcrect->h;
-        if (srcy < 0) {
-            h += srcy;
-            dstrect->y -= srcy;
-            srcy = 0;
-        }
-        maxh = src->h - srcy;
-        if (maxh < h)
-            h = maxh;
-
-    } else {
-        srcx = srcy = 0;
-        w = src->w;
-        h = src->h;
-    }
-
-    /* clip the destination rectangle against the clip rectangle */
-    {
-        SDL_Rect *clip = &dst->clip_rect;
-        int dx, dy;
-
-        dx = clip->x - dstrect->x;
-        if (dx > 0) {
-            w -= dx;
-            dstrect->x += dx;
-            srcx += dx;
-        }
-        dx = dstrect->x + w - clip->x - clip->w;
-        if (dx > 0)
-            w -= dx;
-
-        dy = clip->y - dstrect->y;
-        if (dy > 0) {
-            h -= dy;
-            dstrect->y += dy;
-            srcy += dy;
-        }
-        dy = dstrect->y + h - clip->y - clip->h;
-        if (dy > 0)
-            h -= dy;
-    }
-
-    if (w && h) {
-        unsigned char *srcpix = (unsigned char *)src->pixels;
-        int srcpitch = src->pitch;
-        Uint32 *dstpix = (Uint32 *)dst->pixels;
-#define _blitter(dp, xflip)                                                                                         \
-    do                                                                                                              \
-        for (int y = 0; y < h; y++)                                                                                 \
-            for (int x = 0; x < w; x++) {                                                                           \
-                unsigned char p =                                                                                   \
-                    srcpix[!xflip ? srcx + x + (srcy + y) * srcpitch : srcx + (w - x - 1) + (srcy + y) * srcpitch]; \
-                if (p)                                                                                              \
-                    dstpix[dstrect->x + x + (dstrect->y + y) * dst->w] = getcolor(dp);                              \
-            }                                                                                                       \
-    while (0)
-        if (color && flipx)
-            _blitter(color, 1);
-        else if (!color && flipx)
-            _blitter(p, 1);
-        else if (color && !flipx)
-            _blitter(color, 0);
-        else if (!color && !flipx)
-            _blitter(p, 0);
-#undef _blitter
-    }
-}
-
-static void p8_rectfill(int x0, int y0, int x1, int y1, int col) {
-    int w = (x1 - x0 + 1) * scale;
-    int h = (y1 - y0 + 1) * scale;
-    if (w > 0 && h > 0) {
-        SDL_Rect rc = {x0 * scale, y0 * scale, w, h};
-        SDL_FillRect(screen, &rc, getcolor(col));
+    // show the frame right away, then wait for the next one to be due. with
+    // vsync the same frame is presented again between game frames, the
+    // present is what waits
+    if (frames && use_render_thread) {
+        render_submit(screen_pixels);
+    } else if (frames && bands) {
+        // everything drawn since the previous present
+        p8gfx_record(NULL);
+        bands_play(bands, &band_list, screen_pixels);
+        p8gfx_record(&band_list);
     }
+    if (frames && bands)
+        bands_present(bands, screen_pixels, (Uint32 *)screen->pixels, screen->pitch, scale, screen_lut);
+    else if (frames)
+        p8gfx_present((Uint32 *)screen->pixels, screen->pitch, scale, screen_lut);
+    timing_mark(TIMING_PRESENT);
+    if (frames || pacer_vsync(&pacer))
+        SDL_Flip(screen);
+    pacer_presented(&pacer, frames);
+    timing_mark(TIMING_FLIP);
+    if (!fast_forward)
+        pacer_wait(&pacer);
+    timing_mark(TIMING_SLEEP);
+    timing_end_frame();
 }
 
-static void p8_print(char const *str, int x, int y, int col) {
-    for (char c = *str; c; c = *(++str)) {
-        c &= 0x7F;
-        SDL_Rect srcrc = {8 * (c % 16), 8 * (c / 16)};
-        srcrc.x *= scale;
-        srcrc.y *= scale;
-        srcrc.w = srcrc.h = 8 * scale;
-
-        SDL_Rect dstrc = {x * scale, y * scale, scale, scale};
-        Xblit(font, &srcrc, screen, &dstrc, col, 0, 0);
-        x += 4;
+void P8music(int index, int fade, int mask) { // music(idx,fade,mask)
+    (void)mask; // we do not care about this since sdl mixer keeps sounds and
+                // music separate
+
+    if (index == -1) { // stop playing
+        Mix_FadeOutMusic(fade);
+        current_music = NULL;
+    } else if (mus[index / 10]) {
+        Mix_Music *musi = mus[index / 10];
+        current_music = musi;
+        Mix_FadeInMusic(musi, -1, fade);
     }
 }
 
-int pico8emu(P8 call, ...) {
-    static int camera_x = 0, camera_y = 0;
-    if (!enable_screenshake) {
-        camera_x = camera_y = 0;
-    }
-
-    va_list args;
-    int ret = 0;
-    va_start(args, call);
-
-#define INT_ARG() va_arg(args, int)
-#define BOOL_ARG() (bool)va_arg(args, int)
-#define RET_INT(_i) \
-    do {            \
-        ret = (_i); \
-        goto end;   \
-    } while (0)
-#define RETbool(_b) RET_INT(!!(_b))
-
-    switch (call) {
-    case P8_MUSIC: { // music(idx,fade,mask)
-        int index = INT_ARG();
-        int fade = INT_ARG();
-        int mask = INT_ARG();
-
-        (void)mask; // we do not care about this since sdl mixer keeps sounds and
-                    // music separate
-
-        if (index == -1) { // stop playing
-            Mix_FadeOutMusic(fade);
-            current_music = NULL;
-        } else if (mus[index / 10]) {
-            Mix_Music *musi = mus[index / 10];
-            current_music = musi;
-            Mix_FadeInMusic(musi, -1, fade);
-        }
-    } break;
-    case P8_SPR: { // spr(sprite,x,y,cols,rows,flipx,flipy)
-        int sprite = INT_ARG();
-        int x = INT_ARG();
-        int y = INT_ARG();
-        int cols = INT_ARG();
-        int rows = INT_ARG();
-        int flipx = BOOL_ARG();
-        int flipy = BOOL_ARG();
-
-        (void)cols;
-        (void)rows;
-
-        assert(rows == 1 && cols == 1);
-
-        if (sprite >= 0) {
-            SDL_Rect srcrc = {8 * (sprite % 16), 8 * (sprite / 16)};
-            srcrc.x *= scale;
-            srcrc.y *= scale;
-            srcrc.w = srcrc.h = scale * 8;
-            SDL_Rect dstrc = {(x - camera_x) * scale, (y - camera_y) * scale, scale, scale};
-            Xblit(gfx, &srcrc, screen, &dstrc, 0, flipx, flipy);
-        }
-    } break;
-    case P8_BTN: { // btn(b)
-        int b = INT_ARG();
-        assert(b >= 0 && b <= 5);
-        RETbool(buttons_state & (1 << b));
-    } break;
-    case P8_SFX: { // sfx(id)
-        int id = INT_ARG();
-
-        if (id < (sizeof snd) / (sizeof *snd) && snd[id])
-            Mix_PlayChannel(-1, snd[id], 0);
-    } break;
-    case P8_PAL: { // pal(a,b)
-        int a = INT_ARG();
-        int b = INT_ARG();
-        if (a >= 0 && a < 16 && b >= 0 && b < 16) {
-            // swap palette colors
-            palette[a] = base_palette[b];
-        }
-    } break;
-    case P8_PAL_RESET: { // pal()
-        ResetPalette();
-    } break;
-    case P8_CIRCFILL: { // circfill(x,y,r,col)
-        int cx = INT_ARG() - camera_x;
-        int cy = INT_ARG() - camera_y;
-        int r = INT_ARG();
-        int col = INT_ARG();
-
-        int realcolor = getcolor(col);
-
-        int f = 1 - r;     // used to track the progress of the drawn circle (since
-                           // its semi-recursive)
-        int ddFx = 1;      // step x
-        int ddFy = -2 * r; // step y
-        int x = 0;
-        int y = r;
-
-        // this algorithm doesn't account for the diameters
-        // so we have to set them manually
-        p8_line(cx, cy - y, cx, cy + r, col);
-        p8_line(cx + r, cy, cx - r, cy, col);
-
-        while (x < y) {
-            if (f >= 0) {
-                y--;
-                ddFy += 2;
-                f += ddFy;
-            }
-            x++;
-            ddFx += 2;
-            f += ddFx;
-
-            // build our current arc
-            p8_line(cx + x, cy + y, cx - x, cy + y, col);
-            p8_line(cx + x, cy - y, cx - x, cy - y, col);
-            p8_line(cx + y, cy + x, cx - y, cy + x, col);
-            p8_line(cx + y, cy - x, cx - y, cy - x, col);
-        }
-    } break;
-    case P8_PRINT: { // print(str,x,y,col)
-        char const *str = va_arg(args, char const *);
-        int x = INT_ARG() - camera_x;
-        int y = INT_ARG() - camera_y;
-        int col = INT_ARG() % 16;
-
-        p8_print(str, x, y, col);
-    } break;
-    case P8_RECTFILL: { // rectfill(x0,y0,x1,y1,col)
-        int x0 = INT_ARG() - camera_x;
-        int y0 = INT_ARG() - camera_y;
-        int x1 = INT_ARG() - camera_x;
-        int y1 = INT_ARG() - camera_y;
-        int col = INT_ARG();
-
-        p8_rectfill(x0, y0, x1, y1, col);
-    } break;
-    case P8_LINE: { // line(x0,y0,x1,y1,col)
-        int x0 = INT_ARG() - camera_x;
-        int y0 = INT_ARG() - camera_y;
-        int x1 = INT_ARG() - camera_x;
-        int y1 = INT_ARG() - camera_y;
-        int col = INT_ARG();
-
-        p8_line(x0, y0, x1, y1, col);
-    } break;
-    case P8_MGET: { // mget(tx,ty)
-        int tx = INT_ARG();
-        int ty = INT_ARG();
-
-        RET_INT(tilemap_data[tx + ty * 128]);
-    } break;
-    case P8_CAMERA: { // camera(x,y)
-        if (enable_screenshake) {
-            camera_x = INT_ARG();
-            camera_y = INT_ARG();
-        }
-    } break;
-    case P8_FGET: { // fget(tile,flag)
-        int tile = INT_ARG();
-        int flag = INT_ARG();
-
-        RET_INT(gettileflag(tile, flag));
-    } break;
-    case P8_MAP: { // map(mx,my,tx,ty,mw,mh,mask)
-        int mx = INT_ARG(), my = INT_ARG();
-        int tx = INT_ARG(), ty = INT_ARG();
-        int mw = INT_ARG(), mh = INT_ARG();
-        int mask = INT_ARG();
-
-        for (int x = 0; x < mw; x++) {
-            for (int y = 0; y < mh; y++) {
-                int tile = tilemap_data[x + mx + (y + my) * 128];
-                // hack
-                if (mask == 0 || (mask == 4 && tile_flags[tile] == 4) ||
-                    gettileflag(tile, mask != 4 ? mask - 1 : mask)) {
-                    // al_draw_bitmap(sprites[tile], tx+x*8 - camera_x, ty+y*8 - camera_y,
-                    // 0);
-                    SDL_Rect srcrc = {8 * (tile % 16), 8 * (tile / 16)};
-                    srcrc.x *= scale;
-                    srcrc.y *= scale;
-                    srcrc.w = srcrc.h = scale * 8;
-                    SDL_Rect dstrc = {(tx + x * 8 - camera_x) * scale, (ty + y * 8 - camera_y) * scale, scale * 8, scale * 8};
-
-                    if (0) {
-                        srcrc.x = srcrc.y = 0;
-                        srcrc.w = srcrc.h = 8;
-                        dstrc.x = x * 8, dstrc.y = y * 8;
-                        dstrc.w = dstrc.h = 8;
-                    }
-
-                    // SDL_BlitSurface(gfx, &srcrc, screen, &dstrc);
-                    Xblit(gfx, &srcrc, screen, &dstrc, 0, 0, 0);
-                }
-            }
-        }
-    } break;
-    }
-
-end:
-    va_end(args);
-    return ret;
-}
-
-static int gettileflag(int tile, int flag) {
-    return tile < sizeof(tile_flags) / sizeof(*tile_flags) &&
-           (tile_flags[tile] & (1 << flag)) != 0;
-}
-
-// coordinates should NOT be scaled before calling this
-static void p8_line(int x0, int y0, int x1, int y1, unsigned char color) {
-#define CLAMP(v, min, max) v = v < min ? min : v >= max ? max - 1 \
-                                                        : v;
-    CLAMP(x0, 0, screen->w);
-    CLAMP(y0, 0, screen->h);
-    CLAMP(x1, 0, screen->w);
-    CLAMP(y1, 0, screen->h);
-
-    Uint32 realcolor = getcolor(color);
-
-#undef CLAMP
-#define PLOT(x, y)                                          \
-    do {                                                    \
-        SDL_Rect rc = {x * scale, y * scale, scale, scale}; \
-        SDL_FillRect(screen, &rc, realcolor);               \
-    } while (0)
-    int sx, sy, dx, dy, err, e2;
-    dx = abs(x1 - x0);
-    dy = abs(y1 - y0);
-    if (!dx && !dy)
-        return;
-
-    if (x0 < x1)
-        sx = 1;
-    else
-        sx = -1;
-    if (y0 < y1)
-        sy = 1;
-    else
-        sy = -1;
-    err = dx - dy;
-    if (!dy && !dx)
-        return;
-    else if (!dx) { // vertical line
-        for (int y = y0; y != y1; y += sy)
-            PLOT(x0, y);
-    } else if (!dy) { // horizontal line
-        for (int x = x0; x != x1; x += sx)
-            PLOT(x, y0);
-    }
-    while (x0 != x1 || y0 != y1) {
-        PLOT(x0, y0);
-        e2 = 2 * err;
-        if (e2 > -dy) {
-            err -= dy;
-            x0 += sx;
-        }
-        if (e2 < dx) {
-            err += dx;
-            y0 += sy;
-        }
-    }
-#undef PLOT
+void P8sfx(int id) { // sfx(id)
+    if (id < (sizeof snd) / (sizeof *snd) && snd[id])
+        Mix_PlayChannel(-1, snd[id], 0);
 }
 
 // vim: ts=2 sw=2 noexpandtab
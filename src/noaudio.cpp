@@ -0,0 +1,9 @@
+#include "p8.h"
+
+// silent audio, for every frontend but the sdl one
+
+void P8music(int, int, int) {
+}
+
+void P8sfx(int) {
+}
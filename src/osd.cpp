@@ -0,0 +1,24 @@
+#include <string.h>
+
+#include "osd.h"
+#include "p8gfx.h"
+
+static thread_local char osd_text[200] = "";
+static thread_local int osd_timer = 0;
+
+void osd_show(char const *text) {
+    strncpy(osd_text, text, sizeof osd_text - 1);
+    osd_text[sizeof osd_text - 1] = '\0'; // in case of truncation
+    osd_timer = 30;
+}
+
+void osd_draw(void) {
+    if (osd_timer > 0) {
+        --osd_timer;
+        int const x = 4;
+        int const y = 120 + (osd_timer < 10 ? 10 - osd_timer : 0); // disappear by going below the screen
+        p8gfx_rectfill(x - 2, y - 2, x + 4 * strlen(osd_text), y + 6, 6); // outline
+        p8gfx_rectfill(x - 1, y - 1, x + 4 * strlen(osd_text) - 1, y + 5, 0);
+        p8gfx_print(osd_text, x, y, 7);
+    }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+// on-screen display (for info, such as loading a state, toggling screenshake,
+// toggling fullscreen, etc). a message stays up for a second, then slides off
+// the bottom of the screen. the display is per thread, like the draw palette.
+
+void osd_show(char const *text);
+
+// draws the message into p8gfx_screen, and counts down its timer
+void osd_draw(void);
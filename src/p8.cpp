@@ -1,89 +1,109 @@
-#include "p8.h"
-
-static P8Call _p8call = NULL;
-
-void P8bind(P8Call func) {
-    _p8call = func;
-}
-
-void P8music(int track, int fade, int mask) {
-    _p8call(P8_MUSIC, track, fade, mask);
-}
-
-void P8spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy) {
-    _p8call(P8_SPR, sprite, x, y, cols, rows, flipx, flipy);
-}
+#include <atomic>
+#include <mutex>
 
-bool P8btn(int b) {
-    return _p8call(P8_BTN, b);
-}
-
-void P8sfx(int id) {
-    _p8call(P8_SFX, id);
-}
-
-void P8pal(int a, int b) {
-    _p8call(P8_PAL, a, b);
-}
-
-void P8pal_reset() {
-    _p8call(P8_PAL_RESET);
-}
+#include "p8.h"
 
-void P8circfill(int x, int y, int r, int c) {
-    _p8call(P8_CIRCFILL, x, y, r, c);
-}
+#include "../data/map.inc"
 
-void P8rectfill(int x, int y, int x2, int y2, int c) {
-    _p8call(P8_RECTFILL, x, y, x2, y2, c);
-}
+thread_local P8STATE *P8 = NULL;
 
-void P8print(char const *str, int x, int y, int c) {
-    _p8call(P8_PRINT, str, x, y, c);
-}
+thread_local unsigned P8buttons = 0;
 
-void P8line(int x, int y, int x2, int y2, int c) {
-    _p8call(P8_LINE, x, y, x2, y2, c);
-}
+static bool camera_enabled = true;
 
-int P8mget(int x, int y) {
-    return _p8call(P8_MGET, x, y);
+void P8camera_enable(bool enable) {
+    camera_enabled = enable;
 }
 
-bool P8fget(int t, int f) {
-    return _p8call(P8_FGET, t, f);
+void P8camera(int x, int y) {
+    if (camera_enabled) {
+        P8->camera_x = x;
+        P8->camera_y = y;
+    } else {
+        P8->camera_x = P8->camera_y = 0;
+    }
 }
 
-void P8camera(int x, int y) {
-    _p8call(P8_CAMERA, x, y);
+// whether P8map() draws `tile` for `mask`
+static bool map_draws(int tile, int mask) {
+    // hack
+    return mask == 0 || (mask == 4 && tile_flags[tile] == 4) || P8fget(tile, mask != 4 ? mask - 1 : mask);
+}
+
+// the terrain never changes, so the tiles of a room that a mask draws are
+// rasterized into a layer the first time they are drawn, and that layer is
+// drawn from then on. the layers are shared by every thread
+#define MAP_ROOMS (8 * 4)
+#define MAP_MASKS 4 // 0, 2, 4 and 8
+
+static std::atomic<P8LAYER *> map_layers[MAP_ROOMS][MAP_MASKS];
+static std::mutex map_layers_lock;
+
+static P8LAYER *map_layer(int room, int mask) {
+    int m = mask == 0 ? 0 : mask == 2 ? 1 : mask == 4 ? 2 : 3;
+    P8LAYER *layer = map_layers[room][m].load(std::memory_order_acquire);
+    if (layer)
+        return layer;
+
+    std::lock_guard<std::mutex> lock(map_layers_lock);
+    layer = map_layers[room][m].load(std::memory_order_relaxed);
+    if (!layer) {
+        int sprites[16 * 16];
+        for (int y = 0; y < 16; y++) {
+            for (int x = 0; x < 16; x++) {
+                int tile = tilemap_data[(room % 8) * 16 + x + ((room / 8) * 16 + y) * 128];
+                sprites[x + y * 16] = map_draws(tile, mask) ? tile : -1;
+            }
+        }
+        layer = p8gfx_layer_create(sprites, 16, 16);
+        map_layers[room][m].store(layer, std::memory_order_release);
+    }
+    return layer;
 }
 
 void P8map(int mx, int my, int tx, int ty, int mw, int mh, int mask) {
-    _p8call(P8_MAP, mx, my, tx, ty, mw, mh, mask);
-}
+    if (!p8gfx_screen)
+        return;
+
+    // a whole room
+    if (mx % 16 == 0 && my % 16 == 0 && mx >= 0 && mx < 128 && my >= 0 && my < 64 && mw == 16 && mh == 16 &&
+        (mask == 0 || mask == 2 || mask == 4 || mask == 8)) {
+        P8LAYER *layer = map_layer(mx / 16 + my / 16 * 8, mask);
+        if (layer) {
+            p8gfx_layer(layer, tx, ty);
+            return;
+        }
+    }
 
-static unsigned rnd_seed_lo = 0, rnd_seed_hi = 1;
+    for (int x = 0; x < mw; x++) {
+        for (int y = 0; y < mh; y++) {
+            int tile = tilemap_data[x + mx + (y + my) * 128];
+            if (map_draws(tile, mask))
+                p8gfx_spr(tile, tx + x * 8, ty + y * 8, 1, 1, false, false);
+        }
+    }
+}
 
 void P8srand(unsigned seed) {
     if (seed == 0) {
-        rnd_seed_hi = 0x60009755;
+        P8->rnd_seed_hi = 0x60009755;
         seed = 0xdeadbeef;
     } else {
-        rnd_seed_hi = seed ^ 0xbead29ba;
+        P8->rnd_seed_hi = seed ^ 0xbead29ba;
     }
     for (int i = 0x20; i > 0; i--) {
-        rnd_seed_hi = ((rnd_seed_hi << 16) | (rnd_seed_hi >> 16)) + seed;
-        seed += rnd_seed_hi;
+        P8->rnd_seed_hi = ((P8->rnd_seed_hi << 16) | (P8->rnd_seed_hi >> 16)) + seed;
+        seed += P8->rnd_seed_hi;
     }
-    rnd_seed_lo = seed;
+    P8->rnd_seed_lo = seed;
 }
 
 int P8rndint(int max) { // decomp'd pico-8
     if (!max)
         return 0;
-    rnd_seed_hi = ((rnd_seed_hi << 16) | (rnd_seed_hi >> 16)) + rnd_seed_lo;
-    rnd_seed_lo += rnd_seed_hi;
-    return rnd_seed_hi % (unsigned)max;
+    P8->rnd_seed_hi = ((P8->rnd_seed_hi << 16) | (P8->rnd_seed_hi >> 16)) + P8->rnd_seed_lo;
+    P8->rnd_seed_lo += P8->rnd_seed_hi;
+    return P8->rnd_seed_hi % (unsigned)max;
 };
 
 float P8rnd(float max) {
@@ -6,53 +6,103 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef enum {
-    P8_MUSIC,
-    P8_SPR,
-    P8_BTN,
-    P8_SFX,
-    P8_PAL,
-    P8_PAL_RESET,
-    P8_CIRCFILL,
-    P8_PRINT,
-    P8_RECTFILL,
-    P8_LINE,
-    P8_MGET,
-    P8_CAMERA,
-    P8_FGET,
-    P8_MAP
-} P8;
-
-typedef int (*P8Call)(P8 calltype, ...);
-
-void P8bind(P8Call func);
+#include "p8gfx.h"
 
-void P8music(int track, int fade, int mask);
+// MARK: Backend ---------------------------------------------------------------
 
-void P8spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy);
+// implemented by the frontend the game is linked with (main.cpp for SDL,
+// headless.cpp for the headless runner)
 
-bool P8btn(int b);
+void P8music(int track, int fade, int mask);
 
 void P8sfx(int id);
 
-void P8pal(int a, int b);
+// MARK: State -----------------------------------------------------------------
+
+// the part of the api state that belongs to a game instance, it is kept in the
+// instance's CelesteContext. P8 points to the one of the instance being run on
+// the calling thread
+typedef struct {
+    unsigned rnd_seed_lo, rnd_seed_hi;
+    int camera_x, camera_y;
+} P8STATE;
+
+extern thread_local P8STATE *P8;
 
-void P8pal_reset();
+// MARK: Input -----------------------------------------------------------------
 
-void P8circfill(int x, int y, int r, int c);
+// buttons held during this frame, set by the frontend on the thread that runs
+// the update
+extern thread_local unsigned P8buttons;
 
-void P8rectfill(int x, int y, int x2, int y2, int c);
+static inline bool P8btn(int b) {
+    assert(b >= 0 && b <= 5);
+    return (P8buttons & (1 << b)) != 0;
+}
+
+// MARK: Map -------------------------------------------------------------------
 
-void P8print(char const *str, int x, int y, int c);
+extern unsigned char tilemap_data[];
+extern unsigned char tile_flags[128];
 
-void P8line(int x, int y, int x2, int y2, int c);
+static inline int P8mget(int x, int y) {
+    return tilemap_data[x + y * 128];
+}
 
-int P8mget(int x, int y);
+static inline bool P8fget(int t, int f) {
+    return (unsigned)t < sizeof(tile_flags) / sizeof(*tile_flags) &&
+           (tile_flags[t] & (1 << f)) != 0;
+}
 
-bool P8fget(int t, int f);
+// MARK: Graphics --------------------------------------------------------------
+
+// screenshake setting of the frontend, shared by every instance
+void P8camera_enable(bool enable);
 
 void P8camera(int x, int y);
 
+// a frame is drawn in the game's coordinates into an overscan canvas, the
+// camera is applied once when the frame ends
+static inline void P8frame_begin() {
+    p8gfx_overscan_begin(P8->camera_x, P8->camera_y);
+}
+
+static inline void P8frame_end() {
+    p8gfx_overscan_end();
+}
+
+static inline void P8spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy) {
+    p8gfx_spr(sprite, x, y, cols, rows, flipx, flipy);
+}
+
+static inline void P8pal(int a, int b) {
+    p8gfx_pal(a, b);
+}
+
+static inline void P8pal_reset() {
+    p8gfx_pal_reset();
+}
+
+static inline void P8circfill(int x, int y, int r, int c) {
+    p8gfx_circfill(x, y, r, c);
+}
+
+static inline void P8rectfill(int x, int y, int x2, int y2, int c) {
+    p8gfx_rectfill(x, y, x2, y2, c);
+}
+
+static inline void P8print(char const *str, int x, int y, int c) {
+    p8gfx_print(str, x, y, c % 16);
+}
+
+static inline void P8text_box(int x, int y, int x2, int y2, int bg, char const *str, int n, int tx, int ty, int advance, int c) {
+    p8gfx_text_box(x, y, x2, y2, bg, str, n, tx, ty, advance, c % 16);
+}
+
+static inline void P8line(int x, int y, int x2, int y2, int c) {
+    p8gfx_line(x, y, x2, y2, c);
+}
+
 void P8map(int mx, int my, int tx, int ty, int mw, int mh, int mask);
 
 // MARK: Random ----------------------------------------------------------------
@@ -0,0 +1,1065 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#if defined(__SSE2__)
+#    include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#    include <arm_neon.h>
+#endif
+#if defined(__SSSE3__)
+#    include <tmmintrin.h>
+#endif
+
+#include "p8gfx.h"
+
+thread_local unsigned char *p8gfx_screen = NULL;
+
+// the 8x8 cells of a sheet, 16 to a row, as they are blitted: the 8 pixels
+// of a row in a word, first pixel in the first byte, and a mask of the same
+// layout with 0xff where the pixel is opaque (not 0)
+typedef struct {
+    uint64_t rows[8];
+    uint64_t masks[8];
+} CELL;
+
+typedef struct {
+    CELL *cells;
+    int count;
+} SHEET;
+
+// read-only once set, shared by every thread
+static SHEET gfx, font;
+
+// the 128 glyphs of the font decoded once more: the opaque pixels of their
+// first GLYPH_ROWS rows, a bit per column and GLYPH_STRIDE bits per row, how
+// far into their cells they reach, and the one value of all their opaque
+// pixels (0 when there are several)
+#define GLYPH_ROWS 5
+#define GLYPH_STRIDE 12
+static uint64_t glyph_bits[128];
+static int font_width, font_height;
+static int font_ink;
+
+static thread_local unsigned char palette[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+static thread_local int remapped = 0; // palette entries that are not the identity
+
+// the rows of the screen drawn into, [band_top, band_bottom), only less than
+// the whole screen while playing a band of a display list
+static thread_local int band_top = 0, band_bottom = PICO8_H;
+
+// what the drawing calls draw into. their coordinates are screen coordinates,
+// except in an overscan frame where they are the game's own, and the screen
+// is the window at the camera
+typedef struct {
+    unsigned char *pixels; // NULL for p8gfx_screen
+    int pitch;
+    int origin;                   // index of (0, 0) in the pixels
+    int left, top, right, bottom; // the rectangle drawn into
+    int x, y;                     // the top left corner of the screen
+} VIEW;
+
+static thread_local VIEW view = {NULL, PICO8_W, 0, 0, 0, PICO8_W, PICO8_H, 0, 0};
+
+static inline unsigned char *pixel(int x, int y) {
+    return (view.pixels ? view.pixels : p8gfx_screen) + view.origin + x + y * view.pitch;
+}
+
+// a recorded drawing call, screen coordinates in x0..y1. a sprite has its
+// size in tiles in y1, cols | rows << 16. a text has the offset of its string
+// in the text of the list in x1, its advance in y1
+enum { CMD_SPR, CMD_RECTFILL, CMD_LINE, CMD_CIRCFILL, CMD_TEXT, CMD_PAL, CMD_LAYER, CMD_OVERSCAN_BEGIN, CMD_OVERSCAN_END };
+
+struct P8CMD {
+    int x0, y0, x1, y1;
+    unsigned char op;
+    unsigned char arg; // colour, or the flip bits of a sprite
+};
+
+// the display list the calling thread records into, NULL when drawing
+static thread_local P8DLIST *recording = NULL;
+
+// running out of memory sticks, so that the list is not played with a
+// command missing
+static void record(unsigned char op, int x0, int y0, int x1, int y1, int arg) {
+    P8DLIST *list = recording;
+    if (list->failed)
+        return;
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 1024;
+        P8CMD *cmds = (P8CMD *)realloc(list->cmds, capacity * sizeof *cmds);
+        if (!cmds) {
+            list->failed = true;
+            return;
+        }
+        list->cmds = cmds;
+        list->capacity = capacity;
+    }
+    list->cmds[list->count++] = (P8CMD){x0, y0, x1, y1, op, (unsigned char)arg};
+}
+
+// the part of a cell outside the sheet is transparent
+static void make_sheet(SHEET *sheet, P8SURFACE const *s) {
+    free(sheet->cells);
+    sheet->count = 16 * ((s->h + 7) / 8);
+    sheet->cells = (CELL *)calloc(sheet->count, sizeof *sheet->cells);
+    if (!sheet->cells) {
+        sheet->count = 0;
+        return;
+    }
+    for (int i = 0; i < sheet->count; i++) {
+        CELL *cell = &sheet->cells[i];
+        for (int r = 0; r < 8; r++) {
+            unsigned char row[8] = {0}, mask[8] = {0};
+            int y = 8 * (i / 16) + r;
+            for (int c = 0; c < 8; c++) {
+                int x = 8 * (i % 16) + c;
+                if (x < s->w && y < s->h)
+                    row[c] = s->pixels[x + y * s->w];
+                mask[c] = row[c] ? 0xff : 0;
+            }
+            memcpy(&cell->rows[r], row, 8);
+            memcpy(&cell->masks[r], mask, 8);
+        }
+    }
+}
+
+void p8gfx_set_sheets(P8SURFACE const *gfx_sheet, P8SURFACE const *font_sheet) {
+    make_sheet(&gfx, gfx_sheet);
+    make_sheet(&font, font_sheet);
+    memset(glyph_bits, 0, sizeof glyph_bits);
+    font_width = font_height = font_ink = 0;
+    bool mixed = false;
+    for (int i = 0; i < font.count && i < 128; i++) {
+        for (int r = 0; r < 8; r++) {
+            unsigned char row[8], mask[8];
+            memcpy(row, &font.cells[i].rows[r], 8);
+            memcpy(mask, &font.cells[i].masks[r], 8);
+            for (int c = 0; c < 8; c++) {
+                if (!mask[c])
+                    continue;
+                if (r < GLYPH_ROWS)
+                    glyph_bits[i] |= 1ull << (r * GLYPH_STRIDE + c);
+                font_width = c + 1 > font_width ? c + 1 : font_width;
+                font_height = r + 1 > font_height ? r + 1 : font_height;
+                mixed |= font_ink && row[c] != font_ink;
+                font_ink = row[c];
+            }
+        }
+    }
+    if (mixed)
+        font_ink = 0;
+}
+
+static unsigned get_le(unsigned char const *p, int n) {
+    unsigned v = 0;
+    for (int i = 0; i < n; i++)
+        v |= (unsigned)p[i] << (8 * i);
+    return v;
+}
+
+bool p8gfx_load_bmp(char const *path, P8SURFACE *s) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *file = (unsigned char *)malloc(size > 0 ? size : 1);
+    bool ok = file && size >= 54 && fread(file, size, 1, f) == 1 && file[0] == 'B' && file[1] == 'M';
+    fclose(f);
+
+    int w = 0, h = 0, bpp = 0;
+    unsigned off = 0;
+    if (ok) {
+        off = get_le(file + 10, 4);
+        w = (int)get_le(file + 18, 4);
+        h = (int)get_le(file + 22, 4);
+        bpp = get_le(file + 28, 2);
+        ok = get_le(file + 30, 4) == 0 && (bpp == 1 || bpp == 4 || bpp == 8) && w > 0 && h != 0;
+    }
+    bool bottom_up = h > 0;
+    h = bottom_up ? h : -h;
+    size_t pitch = ((size_t)w * bpp + 31) / 32 * 4;
+    ok = ok && off + pitch * h <= (size_t)size;
+
+    unsigned char *data = ok ? (unsigned char *)malloc(w * h) : NULL;
+    if (data) {
+        for (int y = 0; y < h; y++) {
+            unsigned char const *row = file + off + pitch * (bottom_up ? h - 1 - y : y);
+            for (int x = 0; x < w; x++) {
+                int bit = x * bpp;
+                data[x + y * w] = (row[bit / 8] >> (8 - bpp - bit % 8)) & ((1 << bpp) - 1);
+            }
+        }
+        *s = (P8SURFACE){.w = w, .h = h, .pixels = data};
+    }
+    free(file);
+    return data != NULL;
+}
+
+bool p8gfx_load_sheets(char const *dir) {
+    P8SURFACE gfx_sheet = {0}, font_sheet = {0};
+    char gfx_path[4096], font_path[4096];
+    snprintf(gfx_path, sizeof gfx_path, "%s/gfx.bmp", dir);
+    snprintf(font_path, sizeof font_path, "%s/font.bmp", dir);
+    bool ok = p8gfx_load_bmp(gfx_path, &gfx_sheet) && p8gfx_load_bmp(font_path, &font_sheet);
+    if (ok) // the sheets are copied into cells, the surfaces are not kept
+        p8gfx_set_sheets(&gfx_sheet, &font_sheet);
+    free(gfx_sheet.pixels);
+    free(font_sheet.pixels);
+    return ok;
+}
+
+static void put_le(unsigned char *p, unsigned v, int n) {
+    for (int i = 0; i < n; i++)
+        p[i] = (unsigned char)(v >> (8 * i));
+}
+
+bool p8gfx_save_bmp(char const *path, P8SURFACE const *s) {
+    static unsigned const colors[16] = {0x000000, 0x1d2b53, 0x7e2553, 0x008751, 0xab5236, 0x5f574f,
+                                        0xc2c3c7, 0xfff1e8, 0xff004d, 0xffa300, 0xffec27, 0x00e436,
+                                        0x29adff, 0x83769c, 0xff77a8, 0xffccaa};
+    unsigned const pitch = (s->w + 3) / 4 * 4;
+    unsigned const off = 14 + 40 + 256 * 4;
+    unsigned char header[off] = {'B', 'M'};
+    put_le(header + 2, off + pitch * s->h, 4);
+    put_le(header + 10, off, 4);
+    put_le(header + 14, 40, 4);
+    put_le(header + 18, s->w, 4);
+    put_le(header + 22, s->h, 4); // bottom up
+    put_le(header + 26, 1, 2);
+    put_le(header + 28, 8, 2);
+    put_le(header + 34, pitch * s->h, 4);
+    put_le(header + 46, 256, 4);
+    for (int i = 0; i < 256; i++)
+        put_le(header + 54 + 4 * i, colors[i % 16], 3); // blue, green, red
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(header, sizeof header, 1, f) == 1;
+    unsigned char const padding[4] = {0};
+    for (int y = s->h - 1; ok && y >= 0; y--) {
+        ok = fwrite(s->pixels + y * s->w, s->w, 1, f) == 1 &&
+             (pitch == (unsigned)s->w || fwrite(padding, pitch - s->w, 1, f) == 1);
+    }
+    return fclose(f) == 0 && ok;
+}
+
+static void set_palette(int a, int b) {
+    remapped += (b != a) - (palette[a] != a);
+    palette[a] = b;
+}
+
+// the palette of the recording thread is kept up to date as well, so that it
+// can go back to drawing directly
+
+void p8gfx_pal(int a, int b) {
+    if (a >= 0 && a < 16 && b >= 0 && b < 16) {
+        // swap palette colors
+        set_palette(a, b);
+        if (recording)
+            record(CMD_PAL, a, b, 0, 0, 0);
+    }
+}
+
+void p8gfx_pal_reset(void) {
+    for (int i = 0; i < 16; i++)
+        p8gfx_pal(i, i);
+}
+
+static inline unsigned char getcolor(int idx) {
+    return palette[idx % 16];
+}
+
+// the pixels of a row through the draw palette
+static inline uint64_t remap(uint64_t row) {
+    if (!remapped)
+        return row;
+#if defined(__SSSE3__)
+    __m128i lut = _mm_loadu_si128((__m128i const *)palette);
+    return (uint64_t)_mm_cvtsi128_si64(_mm_shuffle_epi8(lut, _mm_cvtsi64_si128((long long)row)));
+#else
+    unsigned char p[8];
+    memcpy(p, &row, 8);
+    for (int i = 0; i < 8; i++)
+        p[i] = palette[p[i] & 15];
+    memcpy(&row, p, 8);
+    return row;
+#endif
+}
+
+// reverses the 8 pixels of a row
+static inline uint64_t mirror(uint64_t row) {
+    return __builtin_bswap64(row);
+}
+
+// a cell that is entirely within the view horizontally. every row is a
+// single 8 byte read-modify-write through the opacity mask. `color`, when
+// recoloring, is already through the draw palette
+template <bool RECOLOR, bool FLIPX, bool FLIPY>
+static void blit_cell(CELL const *cell, int x, int y, unsigned char color) {
+    int r0 = view.top - y > 0 ? view.top - y : 0;
+    int r1 = view.bottom - y < 8 ? view.bottom - y : 8;
+    int const pitch = view.pitch;
+    uint64_t const fill = color * 0x0101010101010101ull;
+    unsigned char *dst = pixel(x, y);
+    for (int r = r0; r < r1; r++) {
+        int sr = FLIPY ? 7 - r : r;
+        uint64_t mask = cell->masks[sr];
+        if (!mask)
+            continue;
+        uint64_t row = RECOLOR ? fill : remap(cell->rows[sr]);
+        if (FLIPX) {
+            mask = mirror(mask);
+            if (!RECOLOR)
+                row = mirror(row);
+        }
+        uint64_t pixels;
+        memcpy(&pixels, dst + r * pitch, 8);
+        pixels = (pixels & ~mask) | (row & mask);
+        memcpy(dst + r * pitch, &pixels, 8);
+    }
+}
+
+typedef void (*BLITTER)(CELL const *cell, int x, int y, unsigned char color);
+
+// indexed by recolor | flipx << 1 | flipy << 2
+static BLITTER const blitters[8] = {
+    blit_cell<false, false, false>, blit_cell<true, false, false>, blit_cell<false, true, false>,
+    blit_cell<true, true, false>,   blit_cell<false, false, true>, blit_cell<true, false, true>,
+    blit_cell<false, true, true>,   blit_cell<true, true, true>,
+};
+
+// a cell cut by the column `left` or `right`. the sprites used to be flipped
+// after clipping, so a flipx sprite cut by the edge of the screen shows its
+// visible source columns reversed rather than the other end of the sprite, as
+// it always has
+static void blit_clipped(CELL const *cell, int x, int y, unsigned char color, bool recolor, bool flipx, bool flipy,
+                         int left, int right) {
+    int c0 = left - x > 0 ? left - x : 0;
+    int c1 = right - x < 8 ? right - x : 8;
+    int r0 = view.top - y > 0 ? view.top - y : 0;
+    int r1 = view.bottom - y < 8 ? view.bottom - y : 8;
+    for (int r = r0; r < r1; r++) {
+        int sr = flipy ? 7 - r : r;
+        unsigned char row[8], mask[8];
+        memcpy(row, &cell->rows[sr], 8);
+        memcpy(mask, &cell->masks[sr], 8);
+        unsigned char *dst = pixel(x, y + r);
+        for (int c = c0; c < c1; c++) {
+            int sc = flipx ? c0 + c1 - 1 - c : c;
+            if (mask[sc])
+                dst[c] = recolor ? color : palette[row[sc] & 15];
+        }
+    }
+}
+
+// cell `index` of `sheet` at (x, y). a non-zero `color` recolors every opaque
+// pixel, otherwise they are drawn through the draw palette
+static inline void blit(SHEET const *sheet, int index, int x, int y, int color, bool flipx, bool flipy) {
+    if (index < 0 || index >= sheet->count || x <= view.left - 8 || x >= view.right || y <= view.top - 8 ||
+        y >= view.bottom)
+        return;
+    CELL const *cell = &sheet->cells[index];
+    unsigned char c = color ? getcolor(color) : 0;
+    int left = view.left, right = view.right;
+    // in the overscan too, a flipx sprite across the edge of the screen is cut
+    // there
+    if (flipx && ((x < view.x && x > view.x - 8) || (x < view.x + PICO8_W && x > view.x + PICO8_W - 8)))
+        left = view.x, right = view.x + PICO8_W;
+    if (x >= left && x <= right - 8)
+        blitters[(color != 0) | flipx << 1 | flipy << 2](cell, x, y, c);
+    else
+        blit_clipped(cell, x, y, c, color != 0, flipx, flipy, left, right);
+}
+
+// the tile (c, r) of the region is sprite + c + r * 16. the rows of tiles
+// outside the view are skipped at once, every other tile goes through blit(),
+// so a flipx tile across the edge of the screen is still cut on its own
+static void draw_spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy) {
+    if (sprite < 0)
+        return;
+    for (int r = 0; r < rows; r++) {
+        int ty = y + 8 * (flipy ? rows - 1 - r : r);
+        if (ty <= view.top - 8 || ty >= view.bottom)
+            continue;
+        for (int c = 0; c < cols; c++)
+            blit(&gfx, sprite + c + r * 16, x + 8 * (flipx ? cols - 1 - c : c), ty, 0, flipx, flipy);
+    }
+}
+
+static void draw_rectfill(int x0, int y0, int x1, int y1, int col) {
+    if (x0 < view.left)
+        x0 = view.left;
+    if (y0 < view.top)
+        y0 = view.top;
+    if (x1 >= view.right)
+        x1 = view.right - 1;
+    if (y1 >= view.bottom)
+        y1 = view.bottom - 1;
+
+    int w = x1 - x0 + 1;
+    int h = y1 - y0 + 1;
+    if (w > 0 && h > 0) {
+        unsigned char c = getcolor(col);
+        for (int y = y0; y <= y1; y++)
+            memset(pixel(x0, y), c, w);
+    }
+}
+
+// layers //
+////////////
+
+// the pixel rows of the layer with the same layout as the cells, a word per
+// tile column
+struct P8LAYER {
+    int id; // what a display list records
+    int cols, rows;
+    uint64_t *words;
+    uint64_t *masks;
+    short (*spans)[2]; // per pixel row, the words [first, last) with an opaque pixel
+};
+
+// written once per layer, before its id is handed out
+static P8LAYER *layers[P8GFX_MAX_LAYERS];
+static std::atomic<int> layer_count(0);
+
+P8LAYER *p8gfx_layer_create(int const *sprites, int cols, int rows) {
+    int id = layer_count++;
+    if (id >= P8GFX_MAX_LAYERS)
+        return NULL;
+    P8LAYER *layer = (P8LAYER *)calloc(1, sizeof *layer);
+    uint64_t *words = (uint64_t *)calloc((size_t)cols * rows * 8, sizeof *words);
+    uint64_t *masks = (uint64_t *)calloc((size_t)cols * rows * 8, sizeof *masks);
+    short(*spans)[2] = (short(*)[2])calloc((size_t)rows * 8, sizeof *spans);
+    if (!layer || !words || !masks || !spans) {
+        free(layer);
+        free(words);
+        free(masks);
+        free(spans);
+        return NULL;
+    }
+    for (int ty = 0; ty < rows; ty++) {
+        for (int tx = 0; tx < cols; tx++) {
+            int sprite = sprites[tx + ty * cols];
+            if (sprite < 0 || sprite >= gfx.count)
+                continue;
+            for (int r = 0; r < 8; r++) {
+                words[tx + (ty * 8 + r) * cols] = gfx.cells[sprite].rows[r];
+                masks[tx + (ty * 8 + r) * cols] = gfx.cells[sprite].masks[r];
+            }
+        }
+    }
+    for (int r = 0; r < rows * 8; r++) {
+        int first = 0, last = cols;
+        while (first < last && !masks[first + r * cols])
+            first++;
+        while (last > first && !masks[last - 1 + r * cols])
+            last--;
+        spans[r][0] = first;
+        spans[r][1] = last;
+    }
+    *layer = (P8LAYER){id, cols, rows, words, masks, spans};
+    layers[id] = layer;
+    return layer;
+}
+
+static inline void blend_word(unsigned char *dst, uint64_t row, uint64_t mask) {
+    uint64_t pixels;
+    memcpy(&pixels, dst, 8);
+    pixels = (pixels & ~mask) | (row & mask);
+    memcpy(dst, &pixels, 8);
+}
+
+// `n` consecutive words of a row, all within the screen
+static void blend_words(unsigned char *dst, uint64_t const *words, uint64_t const *masks, int n) {
+    int i = 0;
+    if (remapped) {
+        for (; i < n; i++)
+            blend_word(dst + i * 8, remap(words[i]), masks[i]);
+        return;
+    }
+#if defined(__SSE2__)
+    for (; i + 2 <= n; i += 2) {
+        __m128i mask = _mm_loadu_si128((__m128i const *)(masks + i));
+        __m128i row = _mm_loadu_si128((__m128i const *)(words + i));
+        __m128i pixels = _mm_loadu_si128((__m128i const *)(dst + i * 8));
+        pixels = _mm_or_si128(_mm_andnot_si128(mask, pixels), _mm_and_si128(row, mask));
+        _mm_storeu_si128((__m128i *)(dst + i * 8), pixels);
+    }
+#endif
+    for (; i < n; i++)
+        blend_word(dst + i * 8, words[i], masks[i]);
+}
+
+// the words cut by the left or right edge of the view have their columns
+// outside of it shifted out (the first pixel is the low byte), so that every
+// store is 8 bytes within the row
+static void draw_layer(P8LAYER const *layer, int x, int y) {
+    int r0 = view.top - y > 0 ? view.top - y : 0;
+    int r1 = view.bottom - y < layer->rows * 8 ? view.bottom - y : layer->rows * 8;
+    // from the left edge of the view on, the words entirely within it are
+    // [inner0, inner1)
+    int const w = view.right - view.left;
+    x -= view.left;
+    int inner0 = x < 0 ? (-x + 7) / 8 : 0;
+    int inner1 = (w - x) / 8 < layer->cols ? (w - x) / 8 : layer->cols;
+    for (int r = r0; r < r1; r++) {
+        uint64_t const *words = layer->words + r * layer->cols;
+        uint64_t const *masks = layer->masks + r * layer->cols;
+        unsigned char *dst = pixel(view.left, y + r);
+        int first = layer->spans[r][0], last = layer->spans[r][1];
+        if (first >= last)
+            continue;
+
+        int c = inner0 - 1;
+        if (c >= first && c < last && x + c * 8 > -8 && masks[c]) {
+            int shift = -(x + c * 8) * 8;
+            blend_word(dst, remap(words[c]) >> shift, masks[c] >> shift);
+        }
+        int c0 = first > inner0 ? first : inner0;
+        int c1 = last < inner1 ? last : inner1;
+        if (c0 < c1)
+            blend_words(dst + x + c0 * 8, words + c0, masks + c0, c1 - c0);
+        c = inner1;
+        if (c >= first && c < last && x + c * 8 < w && masks[c]) {
+            int shift = (x + c * 8 - (w - 8)) * 8;
+            blend_word(dst + w - 8, remap(words[c]) << shift, masks[c] << shift);
+        }
+    }
+}
+
+// text //
+//////////
+
+static void draw_char(char c, int x, int y, int col) {
+    blit(&font, c & 0x7F, x, y, col, false, false);
+}
+
+// the opacity mask of 8 pixels from 8 bits, the first pixel in bit 0
+static inline uint64_t spread_bits(unsigned bits) {
+    uint64_t m = (bits * 0x0101010101010101ull) & 0x8040201008040201ull;
+    return (((m | (m + 0x7f7f7f7f7f7f7f7full)) & 0x8080808080808080ull) >> 7) * 0xff;
+}
+
+// a line of text is drawn 8 columns at a time: the glyphs that reach into
+// them are shifted into place and or'ed together, every row at once, then
+// each row is blended in one go. that needs glyphs that fit in 5x5, so that
+// a row shifted by up to 11 columns only spills into the low bits of the next
+// one, and a font of a single colour, so that overlapping glyphs come out the
+// same. a line has to be within the view too, anything else is drawn a glyph
+// at a time
+static void draw_text(char const *str, int n, int x, int y, int advance, int col) {
+    int len = 0;
+    while ((n < 0 || len < n) && str[len])
+        len++;
+    if (!len)
+        return;
+    int words = (advance * (len - 1) + font_width + 7) / 8;
+    if (!font_ink || font_width > 5 || font_height > GLYPH_ROWS || advance < 0 || x < view.left ||
+        x + words * 8 > view.right) {
+        for (int i = 0; i < len; i++)
+            draw_char(str[i], x + i * advance, y, col);
+        return;
+    }
+
+    int r0 = view.top - y > 0 ? view.top - y : 0;
+    int r1 = view.bottom - y < font_height ? view.bottom - y : font_height;
+    uint64_t const fill = getcolor(col ? col : font_ink) * 0x0101010101010101ull;
+    int first = 0; // the first glyph that reaches into the columns
+    for (int w = 0; w < words; w++) {
+        int x0 = w * 8;
+        while (first * advance + font_width <= x0)
+            first++;
+        // the columns of the word are the bits [4, 12) of each row, a glyph
+        // from up to 4 columns before them shifts left all the same
+        uint64_t bits = 0;
+        for (int i = first; i < len && i * advance < x0 + 8; i++)
+            bits |= glyph_bits[str[i] & 0x7F] << (i * advance - x0 + 4);
+        if (!bits)
+            continue;
+        unsigned char *dst = pixel(x + x0, y);
+        for (int r = r0; r < r1; r++) {
+            unsigned row = bits >> (r * GLYPH_STRIDE + 4) & 0xff;
+            if (row)
+                blend_word(dst + r * view.pitch, fill, spread_bits(row));
+        }
+    }
+}
+
+// lines and circles //
+/////////////////////////
+
+// the lines used to be clamped against the 4x upscaled screen, keep the same
+// bounds so that lines crossing the right or bottom edge end the same way
+#define LINE_CLAMP_W (PICO8_W * 4)
+#define LINE_CLAMP_H (PICO8_H * 4)
+
+// lines and circles are drawn in screen coordinates, x >= 0 after the clamp
+typedef struct {
+    unsigned char *screen;
+    int pitch;
+    int top, bottom; // the rows drawn into
+    unsigned char color;
+} PEN;
+
+static inline PEN make_pen(int col) {
+    return (PEN){pixel(view.x, view.y), view.pitch, view.top - view.y, view.bottom - view.y, getcolor(col)};
+}
+
+// the pixels [x0, x1] of row y
+static inline void hspan(PEN const *pen, int x0, int x1, int y) {
+    if (y < pen->top || y >= pen->bottom)
+        return;
+    if (x1 >= PICO8_W)
+        x1 = PICO8_W - 1;
+    if (x0 <= x1)
+        memset(pen->screen + x0 + y * pen->pitch, pen->color, x1 - x0 + 1);
+}
+
+// the pixels [y0, y1] of column x
+static inline void vspan(PEN const *pen, int x, int y0, int y1) {
+    if (x >= PICO8_W)
+        return;
+    if (y0 < pen->top)
+        y0 = pen->top;
+    if (y1 >= pen->bottom)
+        y1 = pen->bottom - 1;
+    if (y0 > y1)
+        return;
+    unsigned char *p = pen->screen + x + y0 * pen->pitch;
+    for (int y = y0; y <= y1; y++, p += pen->pitch)
+        *p = pen->color;
+}
+
+// from (x0, y0) to (x1, y1), the end excluded
+static void screen_line(PEN const *pen, int x0, int y0, int x1, int y1) {
+#define CLAMP(v, min, max) v = v < min ? min : v >= max ? max - 1 \
+                                                        : v;
+    CLAMP(x0, 0, LINE_CLAMP_W);
+    CLAMP(y0, 0, LINE_CLAMP_H);
+    CLAMP(x1, 0, LINE_CLAMP_W);
+    CLAMP(y1, 0, LINE_CLAMP_H);
+#undef CLAMP
+
+    // nothing to plot when the line is all above or all below the rows
+    // drawn into
+    int const top = pen->top, bottom = pen->bottom;
+    if ((y0 < top && y1 < top) || (y0 >= bottom && y1 >= bottom))
+        return;
+
+    int dx = abs(x1 - x0);
+    int dy = abs(y1 - y0);
+    int sx = x0 < x1 ? 1 : -1;
+    int sy = y0 < y1 ? 1 : -1;
+    if (!dx && !dy)
+        return;
+    if (!dy) { // horizontal line
+        hspan(pen, sx > 0 ? x0 : x1 + 1, sx > 0 ? x1 - 1 : x0, y0);
+        return;
+    }
+    if (!dx) { // vertical line
+        vspan(pen, x0, sy > 0 ? y0 : y1 + 1, sy > 0 ? y1 - 1 : y0);
+        return;
+    }
+    if (dx == dy) { // diagonal, the steps [lo, hi] are within the screen
+        int lo = 0, hi = dx - 1;
+        if (sx > 0 && hi > PICO8_W - 1 - x0)
+            hi = PICO8_W - 1 - x0;
+        if (sx < 0 && lo < x0 - (PICO8_W - 1))
+            lo = x0 - (PICO8_W - 1);
+        int ylo = sy > 0 ? top - y0 : y0 - (bottom - 1);
+        int yhi = sy > 0 ? bottom - 1 - y0 : y0 - top;
+        lo = lo > ylo ? lo : ylo;
+        hi = hi < yhi ? hi : yhi;
+        if (lo > hi)
+            return;
+        unsigned char *p = pen->screen + x0 + lo * sx + (y0 + lo * sy) * pen->pitch;
+        for (int i = lo; i <= hi; i++, p += sx + sy * pen->pitch)
+            *p = pen->color;
+        return;
+    }
+
+    int err = dx - dy;
+    while (x0 != x1 || y0 != y1) {
+        if (x0 < PICO8_W && y0 >= top && y0 < bottom)
+            pen->screen[x0 + y0 * pen->pitch] = pen->color;
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x0 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+static void draw_line(int x0, int y0, int x1, int y1, int color) {
+    // the clamp is in screen coordinates, so it depends on the camera
+    PEN pen = make_pen(color);
+    screen_line(&pen, x0 - view.x, y0 - view.y, x1 - view.x, y1 - view.y);
+}
+
+// the midpoint circle: the lines of its diameters, then four lines per step.
+// every line is drawn the way screen_line() draws it, end excluded
+static void circle_lines(PEN const *pen, int cx, int cy, int r) {
+    int f = 1 - r;     // used to track the progress of the drawn circle (since
+                       // its semi-recursive)
+    int ddFx = 1;      // step x
+    int ddFy = -2 * r; // step y
+    int x = 0;
+    int y = r;
+
+    // this algorithm doesn't account for the diameters
+    // so we have to set them manually
+    screen_line(pen, cx, cy - y, cx, cy + r);
+    screen_line(pen, cx + r, cy, cx - r, cy);
+
+    while (x < y) {
+        if (f >= 0) {
+            y--;
+            ddFy += 2;
+            f += ddFy;
+        }
+        x++;
+        ddFx += 2;
+        f += ddFx;
+
+        // build our current arc
+        screen_line(pen, cx + x, cy + y, cx - x, cy + y);
+        screen_line(pen, cx + x, cy - y, cx - x, cy - y);
+        screen_line(pen, cx + y, cy + x, cx - y, cy + x);
+        screen_line(pen, cx + y, cy - x, cx - y, cy - x);
+    }
+}
+
+// the same, when no end of a line gets clamped: straight to the spans
+static void circle_spans(PEN const *pen, int cx, int cy, int r) {
+    int f = 1 - r;
+    int ddFx = 1;
+    int ddFy = -2 * r;
+    int x = 0;
+    int y = r;
+
+    vspan(pen, cx, cy - r, cy + r - 1);
+    hspan(pen, cx - r + 1, cx + r, cy);
+
+    while (x < y) {
+        if (f >= 0) {
+            y--;
+            ddFy += 2;
+            f += ddFy;
+        }
+        x++;
+        ddFx += 2;
+        f += ddFx;
+
+        hspan(pen, cx - x + 1, cx + x, cy + y);
+        hspan(pen, cx - x + 1, cx + x, cy - y);
+        hspan(pen, cx - y + 1, cx + y, cy + x);
+        hspan(pen, cx - y + 1, cx + y, cy - x);
+    }
+}
+
+// the small circles (the hair, the orbs) as a few runs per row, taken from
+// circle_spans() around the centre of a scratch bitmap
+#define STAMP_RADII 9
+
+typedef struct {
+    signed char y, x0, x1; // the pixels [x0, x1] of row y, from the centre
+} RUN;
+
+typedef struct {
+    RUN runs[STAMP_RADII * STAMP_RADII * 4];
+    int first[STAMP_RADII + 1]; // the runs of radius r are [first[r], first[r + 1])
+} STAMPS;
+
+static STAMPS make_stamps(void) {
+    enum { C = STAMP_RADII, W = 2 * STAMP_RADII + 1 };
+    STAMPS st;
+    int n = 0;
+    for (int r = 0; r < STAMP_RADII; r++) {
+        unsigned char bitmap[W * W] = {0};
+        PEN pen = {bitmap, W, 0, W, 1};
+        st.first[r] = n;
+        circle_spans(&pen, C, C, r);
+        for (int y = 0; y < W; y++) {
+            for (int x = 0; x < W; x++) {
+                if (!bitmap[x + y * W] || (x > 0 && bitmap[x - 1 + y * W]))
+                    continue;
+                int end = x;
+                while (end + 1 < W && bitmap[end + 1 + y * W])
+                    end++;
+                st.runs[n++] = (RUN){(signed char)(y - C), (signed char)(x - C), (signed char)(end - C)};
+            }
+        }
+    }
+    st.first[STAMP_RADII] = n;
+    return st;
+}
+
+static void draw_circfill(int cx, int cy, int r, int col) {
+    PEN pen = make_pen(col);
+    cx -= view.x;
+    cy -= view.y;
+    if (r < 0 || cx - r < 0 || cy - r < 0 || cx + r >= LINE_CLAMP_W || cy + r >= LINE_CLAMP_H) {
+        // the clamp changes some of the lines
+        circle_lines(&pen, cx, cy, r);
+    } else if (r < STAMP_RADII) {
+        static STAMPS const stamps = make_stamps();
+        for (int i = stamps.first[r]; i < stamps.first[r + 1]; i++) {
+            RUN const *run = &stamps.runs[i];
+            hspan(&pen, cx + run->x0, cx + run->x1, cy + run->y);
+        }
+    } else {
+        circle_spans(&pen, cx, cy, r);
+    }
+}
+
+// overscan //
+//////////////
+
+#define CANVAS_W (PICO8_W + 2 * P8GFX_OVERSCAN)
+#define CANVAS_H (PICO8_H + 2 * P8GFX_OVERSCAN)
+
+// the canvas of the thread, allocated on first use
+static thread_local struct CANVAS {
+    unsigned char *pixels;
+    ~CANVAS() {
+        free(pixels);
+    }
+} canvas;
+
+static VIEW screen_view(void) {
+    return (VIEW){NULL, PICO8_W, 0, 0, band_top, PICO8_W, band_bottom, 0, 0};
+}
+
+static void begin_overscan(int x, int y) {
+    if (!canvas.pixels)
+        canvas.pixels = (unsigned char *)calloc(CANVAS_W, CANVAS_H);
+    if (canvas.pixels && abs(x) <= P8GFX_OVERSCAN && abs(y) <= P8GFX_OVERSCAN) {
+        // the whole canvas, or the rows that end up in the band
+        int top = band_top > 0 ? y + band_top : -P8GFX_OVERSCAN;
+        int bottom = band_bottom < PICO8_H ? y + band_bottom : PICO8_H + P8GFX_OVERSCAN;
+        view = (VIEW){canvas.pixels, CANVAS_W, P8GFX_OVERSCAN * (1 + CANVAS_W), -P8GFX_OVERSCAN, top,
+                      PICO8_W + P8GFX_OVERSCAN, bottom, x, y};
+    } else {
+        // the camera is past the overscan, straight to the screen instead
+        view = (VIEW){NULL, PICO8_W, -x - y * PICO8_W, x, y + band_top, x + PICO8_W, y + band_bottom, x, y};
+    }
+}
+
+static void end_overscan(void) {
+    if (view.pixels) {
+        for (int y = band_top; y < band_bottom; y++)
+            memcpy(p8gfx_screen + y * PICO8_W, pixel(view.x, view.y + y), PICO8_W);
+    }
+    view = screen_view();
+}
+
+// drawing calls //
+///////////////////
+
+void p8gfx_overscan_begin(int camera_x, int camera_y) {
+    if (recording)
+        record(CMD_OVERSCAN_BEGIN, camera_x, camera_y, 0, 0, 0);
+    else if (p8gfx_screen)
+        begin_overscan(camera_x, camera_y);
+}
+
+void p8gfx_overscan_end(void) {
+    if (recording)
+        record(CMD_OVERSCAN_END, 0, 0, 0, 0, 0);
+    else if (p8gfx_screen)
+        end_overscan();
+}
+
+void p8gfx_spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy) {
+    if (recording)
+        record(CMD_SPR, x, y, sprite, cols | rows << 16, flipx | flipy << 1);
+    else if (p8gfx_screen)
+        draw_spr(sprite, x, y, cols, rows, flipx, flipy);
+}
+
+void p8gfx_rectfill(int x0, int y0, int x1, int y1, int col) {
+    if (recording)
+        record(CMD_RECTFILL, x0, y0, x1, y1, col);
+    else if (p8gfx_screen)
+        draw_rectfill(x0, y0, x1, y1, col);
+}
+
+// the string, up to `n` characters, goes into the text of the list
+static void record_text(char const *str, int n, int x, int y, int advance, int col) {
+    P8DLIST *list = recording;
+    int len = 0;
+    while ((n < 0 || len < n) && str[len])
+        len++;
+    if (list->text_size + len + 1 > list->text_capacity) {
+        int capacity = list->text_capacity ? list->text_capacity : 1024;
+        while (capacity < list->text_size + len + 1)
+            capacity *= 2;
+        char *text = (char *)realloc(list->text, capacity);
+        if (!text) {
+            list->failed = true;
+            return;
+        }
+        list->text = text;
+        list->text_capacity = capacity;
+    }
+    record(CMD_TEXT, x, y, list->text_size, advance, col);
+    memcpy(list->text + list->text_size, str, len);
+    list->text[list->text_size + len] = '\0';
+    list->text_size += len + 1;
+}
+
+void p8gfx_print(char const *str, int x, int y, int col) {
+    if (recording)
+        record_text(str, -1, x, y, 4, col);
+    else if (p8gfx_screen)
+        draw_text(str, -1, x, y, 4, col);
+}
+
+void p8gfx_text_box(int x0, int y0, int x1, int y1, int bg, char const *str, int n, int x, int y, int advance,
+                    int col) {
+    if (recording) {
+        record(CMD_RECTFILL, x0, y0, x1, y1, bg);
+        record_text(str, n, x, y, advance, col);
+    } else if (p8gfx_screen) {
+        draw_rectfill(x0, y0, x1, y1, bg);
+        draw_text(str, n, x, y, advance, col);
+    }
+}
+
+void p8gfx_layer(P8LAYER const *layer, int x, int y) {
+    if (recording)
+        record(CMD_LAYER, x, y, layer->id, 0, 0);
+    else if (p8gfx_screen)
+        draw_layer(layer, x, y);
+}
+
+void p8gfx_line(int x0, int y0, int x1, int y1, int col) {
+    if (recording)
+        record(CMD_LINE, x0, y0, x1, y1, col);
+    else if (p8gfx_screen)
+        draw_line(x0, y0, x1, y1, col);
+}
+
+void p8gfx_circfill(int cx, int cy, int r, int col) {
+    if (recording)
+        record(CMD_CIRCFILL, cx, cy, r, 0, col);
+    else if (p8gfx_screen)
+        draw_circfill(cx, cy, r, col);
+}
+
+// display lists //
+///////////////////
+
+void p8gfx_record(P8DLIST *list) {
+    recording = list;
+    if (list) {
+        list->count = 0;
+        list->text_size = 0;
+        list->failed = false;
+        // whatever the palette of the thread that plays it back
+        for (int i = 0; i < 16; i++)
+            record(CMD_PAL, i, palette[i], 0, 0, 0);
+    }
+}
+
+void p8gfx_play(P8DLIST const *list) {
+    p8gfx_play_rows(list, 0, PICO8_H);
+}
+
+void p8gfx_play_rows(P8DLIST const *list, int y0, int y1) {
+    if (!p8gfx_screen || list->failed)
+        return;
+
+    band_top = y0 > 0 ? y0 : 0;
+    band_bottom = y1 < PICO8_H ? y1 : PICO8_H;
+    view = screen_view();
+    for (int i = 0; i < list->count; i++) {
+        P8CMD const *c = &list->cmds[i];
+        switch (c->op) {
+        case CMD_SPR:
+            draw_spr(c->x1, c->x0, c->y0, c->y1 & 0xffff, c->y1 >> 16, c->arg & 1, c->arg & 2);
+            break;
+        case CMD_RECTFILL:
+            draw_rectfill(c->x0, c->y0, c->x1, c->y1, c->arg);
+            break;
+        case CMD_LINE:
+            draw_line(c->x0, c->y0, c->x1, c->y1, c->arg);
+            break;
+        case CMD_CIRCFILL:
+            // the clipping of its lines would do, but there can be many
+            if (c->y0 + abs(c->x1) >= view.top && c->y0 - abs(c->x1) < view.bottom)
+                draw_circfill(c->x0, c->y0, c->x1, c->arg);
+            break;
+        case CMD_TEXT:
+            draw_text(list->text + c->x1, -1, c->x0, c->y0, c->y1, c->arg);
+            break;
+        case CMD_PAL:
+            set_palette(c->x0, c->y0);
+            break;
+        case CMD_LAYER:
+            draw_layer(layers[c->x1], c->x0, c->y0);
+            break;
+        case CMD_OVERSCAN_BEGIN:
+            begin_overscan(c->x0, c->y0);
+            break;
+        case CMD_OVERSCAN_END:
+            end_overscan();
+            break;
+        }
+    }
+    band_top = 0;
+    band_bottom = PICO8_H;
+    view = screen_view();
+}
+
+void p8gfx_dlist_free(P8DLIST *list) {
+    free(list->cmds);
+    free(list->text);
+    *list = (P8DLIST){0};
+}
+
+void p8gfx_present(uint32_t *dst, int pitch, int scale, uint32_t const lut[16]) {
+    p8gfx_present_rows(dst, pitch, scale, lut, 0, PICO8_H);
+}
+
+void p8gfx_present_rows(uint32_t *dst, int pitch, int scale, uint32_t const lut[16], int y0, int y1) {
+    if (!p8gfx_screen)
+        return;
+
+    unsigned char const *src = p8gfx_screen + y0 * PICO8_W;
+    for (int y = y0; y < y1; y++, src += PICO8_W) {
+        uint32_t *row = (uint32_t *)((unsigned char *)dst + y * scale * pitch);
+        if (scale == 4) {
+            // one 4-wide store per source pixel
+            for (int x = 0; x < PICO8_W; x++) {
+#if defined(__SSE2__)
+                _mm_storeu_si128((__m128i *)(row + x * 4), _mm_set1_epi32(lut[src[x] & 15]));
+#elif defined(__ARM_NEON)
+                vst1q_u32(row + x * 4, vdupq_n_u32(lut[src[x] & 15]));
+#else
+                uint32_t c = lut[src[x] & 15];
+                row[x * 4 + 0] = row[x * 4 + 1] = row[x * 4 + 2] = row[x * 4 + 3] = c;
+#endif
+            }
+        } else {
+            for (int x = 0; x < PICO8_W; x++) {
+                uint32_t c = lut[src[x] & 15];
+                for (int i = 0; i < scale; i++)
+                    row[x * scale + i] = c;
+            }
+        }
+        // the remaining rows of the block are copies of the first one
+        for (int i = 1; i < scale; i++)
+            memcpy((unsigned char *)row + i * pitch, row, PICO8_W * scale * sizeof *row);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdint.h>
+
+// software rasterizer for the pico-8 drawing primitives. everything is drawn
+// at native resolution into a 128x128 buffer of palette indices, the draw
+// palette set by pal() is applied while drawing, and the rgb display palette
+// is only applied once per frame by p8gfx_present().
+
+#define PICO8_W 128
+#define PICO8_H 128
+
+typedef struct {
+    int w, h;
+    unsigned char *pixels; // palette indices, pitch == w
+} P8SURFACE;
+
+// the PICO8_W*PICO8_H framebuffer the calling thread draws into, drawing
+// calls are no-ops while it is NULL (the default)
+extern thread_local unsigned char *p8gfx_screen;
+
+// sprite sheet and font, shared by every thread. they are copied, the caller
+// keeps the surfaces
+void p8gfx_set_sheets(P8SURFACE const *gfx, P8SURFACE const *font);
+
+// loads an uncompressed palettized bmp, the pixels are the palette indices.
+// for the frontends without sdl, the pixels are to be freed by the caller
+bool p8gfx_load_bmp(char const *path, P8SURFACE *s);
+
+// loads `dir`/gfx.bmp and `dir`/font.bmp with p8gfx_load_bmp and sets them as
+// the sheets
+bool p8gfx_load_sheets(char const *dir);
+
+// writes an 8 bpp bmp in the pico-8 colours, which loads back as the same
+// palette indices
+bool p8gfx_save_bmp(char const *path, P8SURFACE const *s);
+
+// the draw palette is per thread too
+void p8gfx_pal(int a, int b);
+
+void p8gfx_pal_reset(void);
+
+// coordinates below are screen coordinates, the camera is already applied,
+// except in an overscan frame
+
+// overscan frames: in between, the drawing calls take the game's coordinates
+// and draw into a canvas of the thread that reaches P8GFX_OVERSCAN pixels past
+// every edge of the screen. the end copies the window at the camera to the
+// screen, the only place the camera is applied. lines, and flipped sprites
+// across the edge of the screen, are still cut there as they always were. a
+// camera further out than the overscan draws straight to the screen
+
+#define P8GFX_OVERSCAN 8
+
+void p8gfx_overscan_begin(int camera_x, int camera_y);
+
+void p8gfx_overscan_end(void);
+
+// pico-8's spr(): a region of `cols` x `rows` tiles of the sprite sheet from
+// `sprite` on, the flips flip the whole region
+void p8gfx_spr(int sprite, int x, int y, int cols, int rows, bool flipx, bool flipy);
+
+void p8gfx_rectfill(int x0, int y0, int x1, int y1, int col);
+
+void p8gfx_line(int x0, int y0, int x1, int y1, int col);
+
+void p8gfx_circfill(int cx, int cy, int r, int col);
+
+// the characters are 4 pixels apart
+void p8gfx_print(char const *str, int x, int y, int col);
+
+// a text box: `bg` over [x0, x1] x [y0, y1], then the first `n` characters of
+// `str` (all of them when n < 0) from (x, y) on, `advance` pixels apart. the
+// same as a p8gfx_rectfill() then a p8gfx_print() of each character, in one
+// call
+void p8gfx_text_box(int x0, int y0, int x1, int y1, int bg, char const *str, int n, int x, int y, int advance,
+                    int col);
+
+// layers: a block of tiles of the sprite sheet rasterized once, then drawn
+// as a whole through the draw palette, with the transparent pixels left
+// alone. a layer is shared by every thread and lives until the end of the
+// program, there can be up to P8GFX_MAX_LAYERS of them
+
+#define P8GFX_MAX_LAYERS 256
+
+typedef struct P8LAYER P8LAYER;
+
+// `sprites` holds a sprite per tile, row by row, -1 for an empty tile.
+// returns NULL when out of layers or memory
+P8LAYER *p8gfx_layer_create(int const *sprites, int cols, int rows);
+
+// same as drawing every tile of the layer with p8gfx_spr()
+void p8gfx_layer(P8LAYER const *layer, int x, int y);
+
+// display lists: while a thread records into one, its drawing calls are
+// appended to the list instead of drawn, pal() included. playing the list
+// back on any thread draws the same pixels as the calls would have.
+
+typedef struct P8CMD P8CMD;
+
+typedef struct {
+    P8CMD *cmds;
+    int count, capacity; // the memory is kept from one recording to the next
+    char *text;          // the strings of the recorded text, one after the other
+    int text_size, text_capacity;
+    bool failed; // out of memory while recording, commands are missing
+} P8DLIST;
+
+// clears `list` and records into it until the next call, NULL goes back to
+// drawing
+void p8gfx_record(P8DLIST *list);
+
+// draws the list into p8gfx_screen, leaves the draw palette as recorded. a
+// failed list draws nothing
+void p8gfx_play(P8DLIST const *list);
+
+// same, but only draws the rows [y0, y1). the lists of a frame can be played
+// by several threads at once, each one over its own band of rows
+void p8gfx_play_rows(P8DLIST const *list, int y0, int y1);
+
+void p8gfx_dlist_free(P8DLIST *list);
+
+// expands the palette indices through `lut` into a 32-bit surface, scaling
+// each pixel up to a `scale`x`scale` block
+void p8gfx_present(uint32_t *dst, int pitch, int scale, uint32_t const lut[16]);
+
+// same, for the source rows [y0, y1) only
+void p8gfx_present_rows(uint32_t *dst, int pitch, int scale, uint32_t const lut[16], int y0, int y1);
@@ -0,0 +1,113 @@
+#include <SDL.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+#include "pacer.h"
+
+// presents that return this many times in a row without waiting for a
+// refresh mean that vsync is not in effect
+#define FAST_FLIPS_LIMIT 8
+
+void pacer_init(PACER *p, int fps, int refresh_rate) {
+    *p = (PACER){0};
+    p->freq = SDL_GetPerformanceFrequency();
+    p->period = p->freq / fps;
+    if (refresh_rate >= fps) {
+        p->refresh = p->freq / refresh_rate;
+        // a whole number of refreshes per frame, so that rounding does not
+        // drift a frame every few hours
+        if (refresh_rate % fps == 0)
+            p->period = p->refresh * (refresh_rate / fps);
+    }
+    p->margin = p->freq / 500; // 2 ms until the scheduler proves better or worse
+    p->last = p->last_flip = SDL_GetPerformanceCounter();
+    p->accumulator = p->period; // the first call runs a frame
+}
+
+bool pacer_vsync(PACER const *p) {
+    return p->refresh != 0;
+}
+
+int pacer_frames(PACER *p) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t elapsed = now - p->last;
+    p->last = now;
+    if (p->refresh) // whole refreshes, the present timing noise is dropped
+        elapsed = (elapsed + p->refresh / 2) / p->refresh * p->refresh;
+    p->accumulator += elapsed;
+
+    int frames = (int)(p->accumulator / p->period);
+    p->accumulator -= frames * p->period;
+    if (frames > 3) // after a stall, carry on rather than catch up
+        frames = 1, p->accumulator = 0;
+    return frames;
+}
+
+void pacer_presented(PACER *p, int frames) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (p->refresh) {
+        p->fast_flips = now - p->last_flip < p->refresh / 2 ? p->fast_flips + 1 : 0;
+        if (p->fast_flips >= FAST_FLIPS_LIMIT)
+            p->refresh = 0;
+    }
+    p->last_flip = now;
+
+    if (frames == 1 && p->last_present) {
+        uint64_t us = (now - p->last_present) * 1000000 / p->freq;
+        p->intervals[p->timed++ % PACER_HISTORY] = (uint32_t)std::min<uint64_t>(us, UINT32_MAX);
+    }
+    if (frames) // presents of the same frame again, under vsync, do not break the chain
+        p->last_present = frames == 1 ? now : 0;
+}
+
+void pacer_wait(PACER *p) {
+    if (p->refresh)
+        return;
+    uint64_t deadline = p->last + (p->period - p->accumulator);
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (now >= deadline)
+        return;
+
+    // sleep through most of the wait, SDL_Delay only has millisecond
+    // granularity and wakes up late by however much the scheduler feels like
+    if (deadline - now > p->margin) {
+        Uint32 ms = (Uint32)((deadline - now - p->margin) * 1000 / p->freq);
+        if (ms > 0) {
+            SDL_Delay(ms);
+            uint64_t woke = SDL_GetPerformanceCounter();
+            uint64_t asked = ms * p->freq / 1000;
+            uint64_t late = woke - now > asked ? woke - now - asked : 0;
+            // jump up to the worst lateness seen, decay slowly back down
+            if (late > p->margin)
+                p->margin = std::min(late, p->freq / 100);
+            else
+                p->margin = std::max(p->margin - p->margin / 64, p->freq / 2000);
+        }
+    }
+    while (SDL_GetPerformanceCounter() < deadline)
+        ;
+}
+
+void pacer_stats(PACER const *p, PACER_STATS *stats) {
+    int n = (int)std::min<long>(p->timed, PACER_HISTORY);
+    *stats = (PACER_STATS){.frames = p->timed};
+    if (!n)
+        return;
+
+    double period = (double)p->period * 1000 / p->freq;
+    double sum = 0, sum2 = 0;
+    double jitter[PACER_HISTORY];
+    for (int i = 0; i < n; i++) {
+        double ms = p->intervals[i] / 1000.0;
+        sum += ms, sum2 += ms * ms;
+        jitter[i] = fabs(ms - period);
+    }
+    stats->mean = sum / n;
+    stats->stddev = sqrt(std::max(sum2 / n - stats->mean * stats->mean, 0.0));
+    int k = std::min(n - 1, (int)ceil(n * 0.99) - 1);
+    std::nth_element(jitter, jitter + k, jitter + n);
+    stats->p99_jitter = jitter[k];
+    stats->max_jitter = *std::max_element(jitter + k, jitter + n);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+// frame pacer: runs the game at a fixed 30 updates per second whatever the
+// display does. time goes into an accumulator that is drained one game frame
+// at a time.
+//
+// with vsync the present call does the waiting, and the accumulator is fed
+// whole refresh periods counted from the time between presents, so that game
+// frames land on a steady pattern of refreshes (every 2nd one at 60 Hz). if
+// presents turn out not to block, the pacer falls back to waiting itself:
+// sleeping until shortly before the deadline, then spinning. the sleep margin
+// follows how late the scheduler has been waking up.
+
+#define PACER_HISTORY 1024
+
+typedef struct {
+    uint64_t freq;       // counter ticks per second
+    uint64_t period;     // ticks per game frame
+    uint64_t refresh;    // ticks per display refresh, 0 when not using vsync
+    uint64_t last;       // previous call of pacer_frames()
+    uint64_t accumulator;
+    uint64_t margin;     // woken up this early before spinning
+    uint64_t last_flip;  // previous present
+    int fast_flips;      // consecutive presents that returned before a refresh
+    // time between the presents of consecutive single game frames
+    uint64_t last_present; // 0 when the previous present was not one
+    uint32_t intervals[PACER_HISTORY]; // microseconds, ring
+    long timed;                        // intervals recorded
+} PACER;
+
+typedef struct {
+    long frames; // timed, the stats cover the last PACER_HISTORY of them
+    double mean, stddev; // ms
+    double p99_jitter;   // ms away from the frame period
+    double max_jitter;   // ms
+} PACER_STATS;
+
+// `refresh_rate` is the display's in Hz, 0 when unknown or not presenting
+// with vsync
+void pacer_init(PACER *p, int fps, int refresh_rate);
+
+bool pacer_vsync(PACER const *p);
+
+// number of game frames due since the previous call, at most a few so that a
+// stall is not followed by a burst of catch-up frames
+int pacer_frames(PACER *p);
+
+// to call after presenting, with the number of game frames run since the
+// previous present. only the presents of single frames are timed, so fast
+// forwarding does not count
+void pacer_presented(PACER *p, int frames);
+
+// without vsync: waits until the next game frame is due
+void pacer_wait(PACER *p);
+
+void pacer_stats(PACER const *p, PACER_STATS *stats);
@@ -0,0 +1,82 @@
+#include <string.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "bands.h"
+#include "p8gfx.h"
+#include "render.h"
+
+static P8DLIST lists[2];
+static int back; // the list being recorded
+
+static BANDS *bands; // NULL when drawing on the render thread alone
+static std::thread thread;
+static std::mutex lock;
+static std::condition_variable wake, done;
+static P8DLIST *pending; // handed over, not drawn yet
+static bool quit;
+
+static unsigned char canvas[PICO8_W * PICO8_H];
+
+static void render_loop(void) {
+    p8gfx_screen = canvas;
+    std::unique_lock<std::mutex> l(lock);
+    for (;;) {
+        wake.wait(l, [] { return pending || quit; });
+        if (!pending)
+            break;
+        P8DLIST *list = pending;
+        l.unlock();
+        if (bands)
+            bands_play(bands, list, canvas);
+        else
+            p8gfx_play(list);
+        l.lock();
+        pending = NULL;
+        done.notify_one();
+    }
+}
+
+bool render_start(int band_count) {
+    quit = false;
+    bands = band_count > 1 ? bands_create(band_count) : NULL;
+    try {
+        thread = std::thread(render_loop);
+    } catch (...) {
+        if (bands)
+            bands_destroy(bands);
+        return false;
+    }
+    back = 0;
+    p8gfx_record(&lists[back]);
+    return true;
+}
+
+void render_stop(void) {
+    p8gfx_record(NULL);
+    {
+        std::lock_guard<std::mutex> l(lock);
+        quit = true;
+    }
+    wake.notify_one();
+    thread.join();
+    if (bands)
+        bands_destroy(bands);
+    for (P8DLIST &list : lists)
+        p8gfx_dlist_free(&list);
+}
+
+void render_submit(unsigned char *frame) {
+    p8gfx_record(NULL);
+    {
+        std::unique_lock<std::mutex> l(lock);
+        done.wait(l, [] { return !pending; });
+        memcpy(frame, canvas, sizeof canvas);
+        pending = &lists[back];
+    }
+    wake.notify_one();
+    back ^= 1;
+    p8gfx_record(&lists[back]);
+}
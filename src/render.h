@@ -0,0 +1,22 @@
+#pragma once
+
+// render thread: the game thread records the drawing of its frames into a
+// display list, and a thread of its own rasterizes it while the game thread
+// goes on with the next frame. the lists are double buffered, recording is
+// lock free, and the two threads only meet once per frame when a list is
+// handed over. a frame comes out one submit later than it was drawn.
+//
+// what the render thread draws into persists from frame to frame, like a
+// framebuffer drawn into directly: frames that do not redraw everything
+// (paused, frozen) come out the same.
+
+// starts the thread, and recording the drawing of the calling thread. with
+// `bands` > 1 the thread draws with as many threads, see bands.h
+bool render_start(int bands);
+
+// stops recording, and the thread
+void render_stop(void);
+
+// ends the current list and hands it over, then starts recording the next
+// one. `frame` gets the previous list's result, PICO8_W*PICO8_H indices
+void render_submit(unsigned char *frame);
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+// the longest run encoded, so that its length fits in 4 bytes
+#define MAX_RUN ((1u << 28) - 1)
+
+static bool reserve(REPLAY *r, size_t n) {
+    if (r->size + n <= r->cap)
+        return true;
+    size_t cap = r->cap ? r->cap * 2 : 1024;
+    while (cap < r->size + n)
+        cap *= 2;
+    unsigned char *data = (unsigned char *)realloc(r->data, cap);
+    if (!data)
+        return false;
+    r->data = data;
+    r->cap = cap;
+    return true;
+}
+
+// appends the pending run. running out of memory sticks, so that the
+// recording is not saved with frames missing
+static void flush_run(REPLAY *r) {
+    if (!r->run)
+        return;
+    if (!reserve(r, 5)) {
+        r->failed = true;
+        return;
+    }
+    r->data[r->size++] = (unsigned char)r->mask;
+    unsigned v = r->run;
+    while (v >= 0x80) {
+        r->data[r->size++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    r->data[r->size++] = (unsigned char)v;
+    r->run = 0;
+}
+
+void replay_record_start(REPLAY *r, unsigned seed) {
+    r->seed = seed;
+    r->frames = 0;
+    r->size = 0;
+    r->mask = 0;
+    r->run = 0;
+    r->pos = 0;
+    r->left = 0;
+    r->failed = false;
+}
+
+void replay_record(REPLAY *r, int mask) {
+    if (r->failed)
+        return;
+    if (r->run && (mask != r->mask || r->run == MAX_RUN))
+        flush_run(r);
+    r->mask = mask;
+    r->run++;
+    r->frames++;
+}
+
+static void put_u32(unsigned char *p, unsigned v) {
+    p[0] = v, p[1] = v >> 8, p[2] = v >> 16, p[3] = v >> 24;
+}
+
+static unsigned get_u32(unsigned char const *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned)p[3] << 24;
+}
+
+bool replay_save(REPLAY *r, char const *path) {
+    flush_run(r);
+    if (r->failed)
+        return false;
+
+    unsigned char header[16] = {'C', 'C', 'R', 'P'};
+    put_u32(header + 4, REPLAY_VERSION);
+    put_u32(header + 8, r->seed);
+    put_u32(header + 12, (unsigned)r->frames);
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(header, sizeof header, 1, f) == 1 &&
+              (!r->size || fwrite(r->data, r->size, 1, f) == 1);
+    return fclose(f) == 0 && ok;
+}
+
+// decodes the run at `*pos`, false when it is cut short or its length takes
+// more than 4 bytes
+static bool get_run(REPLAY const *r, size_t *pos, int *mask, unsigned *run) {
+    if (*pos >= r->size)
+        return false;
+    *mask = r->data[(*pos)++];
+    unsigned v = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (*pos >= r->size)
+            return false;
+        unsigned char b = r->data[(*pos)++];
+        v |= (unsigned)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *run = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool replay_load(REPLAY *r, char const *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    unsigned char header[16];
+    bool ok = fread(header, sizeof header, 1, f) == 1 &&
+              !memcmp(header, "CCRP", 4) && get_u32(header + 4) == REPLAY_VERSION;
+    if (ok) {
+        replay_record_start(r, get_u32(header + 8));
+        r->frames = get_u32(header + 12);
+        unsigned char buf[4096];
+        size_t n;
+        while (ok && (n = fread(buf, 1, sizeof buf, f)) > 0) {
+            ok = reserve(r, n);
+            if (ok) {
+                memcpy(r->data + r->size, buf, n);
+                r->size += n;
+            }
+        }
+    }
+    fclose(f);
+    for (size_t pos = 0; ok && pos < r->size;) {
+        int mask;
+        unsigned run;
+        ok = get_run(r, &pos, &mask, &run);
+    }
+    return ok;
+}
+
+bool replay_next(REPLAY *r, int *mask) {
+    while (!r->left) {
+        if (!get_run(r, &r->pos, &r->mask, &r->left))
+            return false;
+    }
+    r->left--;
+    *mask = r->mask;
+    return true;
+}
+
+void replay_free(REPLAY *r) {
+    free(r->data);
+    memset(r, 0, sizeof *r);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+
+// input replays: the rng seed and the input of every updated frame, enough to
+// reproduce a run exactly.
+//
+// file format, integers little endian:
+//   "CCRP", u32 version, u32 seed, u32 frame count
+//   then (u8 mask, LEB128 run length) pairs, one per run of equal masks
+
+#define REPLAY_VERSION 1
+
+// the low 6 bits of a mask are the buttons, the others are frontend events
+// applied before the frame is updated
+enum {
+    REPLAY_BUTTONS = 0x3f,
+    REPLAY_SKIP = 1 << 6,  // Celeste_P8__DEBUG()
+    REPLAY_RESET = 1 << 7, // restore the state saved after seeding, then Celeste_P8_init()
+};
+
+typedef struct {
+    unsigned seed;
+    long frames;
+    unsigned char *data; // encoded runs
+    size_t size, cap;
+    bool failed; // out of memory while recording, the runs are incomplete
+    // recording: the run not yet encoded
+    int mask;
+    unsigned run;
+    // playback
+    size_t pos;
+    unsigned left;
+} REPLAY;
+
+void replay_record_start(REPLAY *r, unsigned seed);
+
+void replay_record(REPLAY *r, int mask);
+
+// false too when the recording ran out of memory
+bool replay_save(REPLAY *r, char const *path);
+
+// loads a replay and rewinds it for playback, false for a truncated or
+// corrupt one
+bool replay_load(REPLAY *r, char const *path);
+
+// mask of the next frame, false once all the frames were played
+bool replay_next(REPLAY *r, int *mask);
+
+void replay_free(REPLAY *r);
@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+typedef struct {
+    unsigned char *data; // encoded snapshots, back to back
+    size_t size, cap;
+    size_t *offsets; // start of each snapshot in data
+    int count;
+} GROUP;
+
+struct REWIND {
+    size_t state_size;
+    int interval;
+    GROUP *groups; // ring of max_groups groups, the oldest at `first`
+    int max_groups, first, group_count;
+    int frames;
+    unsigned char *key;     // keyframe of the newest group
+    unsigned char *zero;    // what keyframes are xor'd against
+    unsigned char *scratch; // encoder output
+};
+
+// the encoded form is a sequence of (equal run, literal run, literals), the
+// run lengths as LEB128 varints and the literals xor'd against the reference
+
+static size_t put_varint(unsigned char *out, size_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static size_t get_varint(unsigned char const *in, size_t *v) {
+    size_t n = 0;
+    int shift = 0;
+    *v = 0;
+    do {
+        *v |= (size_t)(in[n] & 0x7f) << shift;
+        shift += 7;
+    } while (in[n++] & 0x80);
+    return n;
+}
+
+static size_t encode(unsigned char *out, unsigned char const *src, unsigned char const *ref, size_t n) {
+    size_t o = 0;
+    size_t i = 0;
+    while (i < n) {
+        size_t run = i;
+        // skip equal bytes, a word at a time while possible
+        while (i + 8 <= n) {
+            uint64_t a, b;
+            memcpy(&a, src + i, 8);
+            memcpy(&b, ref + i, 8);
+            if (a != b)
+                break;
+            i += 8;
+        }
+        while (i < n && src[i] == ref[i])
+            i++;
+        size_t lit = i;
+        // literals stop at the first run of 3 equal bytes, shorter runs are
+        // cheaper to store as literals
+        while (i < n && !(src[i] == ref[i] && i + 2 < n && src[i + 1] == ref[i + 1] && src[i + 2] == ref[i + 2]))
+            i++;
+        if (i + 2 >= n) // not enough left for a run worth encoding
+            i = n;
+        while (i > lit && src[i - 1] == ref[i - 1]) // trailing equal bytes
+            i--;
+
+        o += put_varint(out + o, lit - run);
+        o += put_varint(out + o, i - lit);
+        for (size_t k = lit; k < i; k++)
+            out[o++] = src[k] ^ ref[k];
+        if (i == lit) // only equal bytes were left
+            break;
+    }
+    return o;
+}
+
+// `dst` holds the reference, the encoded differences are applied to it
+static void decode(unsigned char *dst, unsigned char const *in, size_t len) {
+    unsigned char const *end = in + len;
+    size_t p = 0;
+    while (in < end) {
+        size_t run, lit;
+        in += get_varint(in, &run);
+        in += get_varint(in, &lit);
+        p += run;
+        for (size_t k = 0; k < lit; k++)
+            dst[p++] ^= *in++;
+    }
+}
+
+REWIND *rewind_create(size_t state_size, int max_frames, int keyframe_interval) {
+    REWIND *rw = (REWIND *)calloc(1, sizeof *rw);
+    if (!rw)
+        return NULL;
+    rw->state_size = state_size;
+    rw->interval = keyframe_interval;
+    rw->max_groups = (max_frames + keyframe_interval - 1) / keyframe_interval;
+    rw->groups = (GROUP *)calloc(rw->max_groups, sizeof *rw->groups);
+    rw->key = (unsigned char *)malloc(state_size);
+    rw->zero = (unsigned char *)calloc(1, state_size);
+    // worst case: a 3 byte run and a 1 byte literal every 4 bytes
+    rw->scratch = (unsigned char *)malloc(state_size * 2 + 16);
+    bool ok = rw->groups && rw->key && rw->zero && rw->scratch;
+    for (int i = 0; ok && i < rw->max_groups; i++) {
+        rw->groups[i].offsets = (size_t *)malloc(keyframe_interval * sizeof(size_t));
+        ok = rw->groups[i].offsets != NULL;
+    }
+    if (!ok) {
+        rewind_destroy(rw);
+        return NULL;
+    }
+    return rw;
+}
+
+void rewind_destroy(REWIND *rw) {
+    if (!rw)
+        return;
+    for (int i = 0; rw->groups && i < rw->max_groups; i++) {
+        free(rw->groups[i].data);
+        free(rw->groups[i].offsets);
+    }
+    free(rw->groups);
+    free(rw->key);
+    free(rw->zero);
+    free(rw->scratch);
+    free(rw);
+}
+
+static GROUP *newest_group(REWIND *rw) {
+    return &rw->groups[(rw->first + rw->group_count - 1) % rw->max_groups];
+}
+
+void rewind_push(REWIND *rw, void const *state) {
+    // a new group goes into the slot after the newest one, which is the
+    // oldest one's when the ring is full. nothing changes until its storage
+    // is there, so that running out of memory only drops this frame
+    bool start = !rw->group_count || newest_group(rw)->count == rw->interval;
+    GROUP *g = start ? &rw->groups[(rw->first + rw->group_count) % rw->max_groups] : newest_group(rw);
+    size_t size = start ? 0 : g->size;
+    size_t len = encode(rw->scratch, (unsigned char const *)state, start ? rw->zero : rw->key, rw->state_size);
+    if (size + len > g->cap) {
+        // groups keep their storage when recycled, so this stops happening
+        // once the buffer has wrapped around
+        size_t cap = g->cap ? g->cap * 2 : 4096;
+        while (cap < size + len)
+            cap *= 2;
+        unsigned char *data = (unsigned char *)realloc(g->data, cap);
+        if (!data)
+            return;
+        g->data = data;
+        g->cap = cap;
+    }
+
+    if (start) {
+        // dropping the oldest group when full
+        if (rw->group_count == rw->max_groups) {
+            rw->frames -= g->count;
+            rw->first = (rw->first + 1) % rw->max_groups;
+            rw->group_count--;
+        }
+        g->count = 0;
+        g->size = 0;
+        rw->group_count++;
+        memcpy(rw->key, state, rw->state_size);
+    }
+    memcpy(g->data + g->size, rw->scratch, len);
+    g->offsets[g->count++] = g->size;
+    g->size += len;
+    rw->frames++;
+}
+
+bool rewind_pop(REWIND *rw, void *state) {
+    // an empty group has no keyframe to decode
+    while (rw->group_count && !newest_group(rw)->count)
+        rw->group_count--;
+    if (!rw->group_count)
+        return false;
+
+    GROUP *g = newest_group(rw);
+    int last = g->count - 1;
+    // the keyframe is decoded again each time, since popping can step back
+    // into an older group
+    size_t key_end = g->count > 1 ? g->offsets[1] : g->size;
+    memset(rw->key, 0, rw->state_size);
+    decode(rw->key, g->data, key_end);
+    memcpy(state, rw->key, rw->state_size);
+    if (last > 0)
+        decode((unsigned char *)state, g->data + g->offsets[last], g->size - g->offsets[last]);
+
+    g->size = g->offsets[last];
+    g->count--;
+    if (!g->count)
+        rw->group_count--;
+    rw->frames--;
+    return true;
+}
+
+void rewind_clear(REWIND *rw) {
+    for (int i = 0; i < rw->max_groups; i++) {
+        rw->groups[i].count = 0;
+        rw->groups[i].size = 0;
+    }
+    rw->first = rw->group_count = rw->frames = 0;
+}
+
+int rewind_count(REWIND const *rw) {
+    return rw->frames;
+}
+
+size_t rewind_size(REWIND const *rw) {
+    size_t size = 0;
+    for (int i = 0; i < rw->group_count; i++)
+        size += rw->groups[(rw->first + i) % rw->max_groups].size;
+    return size;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+
+// rewind buffer: keeps the most recent game state snapshots (see
+// Celeste_P8_save_state) so that they can be restored newest first.
+//
+// snapshots are stored in groups that start with a keyframe. every snapshot
+// is xor'd against the keyframe of its group (a keyframe against zero) and
+// the result is run-length encoded, which makes most of them a few hundred
+// bytes. when the buffer is full the oldest group is dropped.
+
+typedef struct REWIND REWIND;
+
+// `max_frames` is rounded up to a whole number of groups of
+// `keyframe_interval` snapshots
+REWIND *rewind_create(size_t state_size, int max_frames, int keyframe_interval);
+
+void rewind_destroy(REWIND *rw);
+
+void rewind_push(REWIND *rw, void const *state);
+
+// restores the newest snapshot into `state` and drops it, returns false when
+// the buffer is empty
+bool rewind_pop(REWIND *rw, void *state);
+
+void rewind_clear(REWIND *rw);
+
+// number of snapshots held
+int rewind_count(REWIND const *rw);
+
+// bytes used by the encoded snapshots held
+size_t rewind_size(REWIND const *rw);
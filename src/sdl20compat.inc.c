@@ -5,6 +5,7 @@ enum {
     SDL_LOGPAL = 2,
     SDL_SRCCOLORKEY = 4,
     SDL_HWPALETTE = 8,
+    SDL_DOUBLEBUF = 16, // presents wait for vsync
 };
 
 static SDL_Surface *sdl2_screen = NULL;
@@ -21,7 +22,7 @@ static SDL_Surface *SDL_SetVideoMode(int width, int height, int bpp, Uint32 flag
             SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, width, height, SDL_WINDOW_RESIZABLE);
         if (!sdl2_window)
             goto die;
-        sdl2_rendr = SDL_CreateRenderer(sdl2_window, -1, 0);
+        sdl2_rendr = SDL_CreateRenderer(sdl2_window, -1, flags & SDL_DOUBLEBUF ? SDL_RENDERER_PRESENTVSYNC : 0);
         SDL_RenderSetLogicalSize(sdl2_rendr, width, height);
         if (!sdl2_rendr)
             goto die;
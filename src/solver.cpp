@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "celeste.h"
+#include "p8.h"
+#include "replay.h"
+#include "tools.h"
+
+// tas solver: searches the button sequence that leaves a room in the fewest
+// frames. the search is breadth first, one frame per layer, so the first
+// layer where a state reaches the next room gives the fastest exit found.
+//
+// states are branched from snapshots. a transposition table of state keys
+// (Celeste_P8_hash_key) prunes states already reached, and when a layer grows
+// past the beam width only the states closest to the top of the screen, where
+// every room exits, are kept. half of them are picked with at most a few per
+// spot of the room, so that the beam does not all pile up under a ceiling.
+// the beam makes the solution the fastest one found, a wider beam can find
+// faster exits. without a beam (-b 0) every state is kept and the solution is
+// the fastest there is, for as much time and memory as that takes.
+//
+// the result is written as a replay that starts from the title screen, plays
+// to the room with REPLAY_SKIP and then plays the solution.
+
+// one frame the way replays are played back
+static void step(CelesteContext *game, int mask) {
+    if (mask & REPLAY_SKIP)
+        Celeste_P8__DEBUG(game);
+    P8buttons = mask & REPLAY_BUTTONS;
+    Celeste_P8_update(game);
+    Celeste_P8_draw(game);
+}
+
+// the inputs tried every frame: every direction (or none) with or without
+// jump and dash. left+right and up+down are left out, the game treats them
+// like no direction
+static std::vector<unsigned char> make_actions(void) {
+    std::vector<unsigned char> actions;
+    int const horizontal[] = {0, 1 << 0, 1 << 1};
+    int const vertical[] = {0, 1 << 2, 1 << 3};
+    for (int hx : horizontal)
+        for (int vy : vertical)
+            for (int buttons = 0; buttons < 4; buttons++)
+                actions.push_back((unsigned char)(hx | vy | buttons << 4));
+    return actions;
+}
+
+// transposition table //
+/////////////////////////
+
+// open addressing over atomic keys, 0 marks a free slot. a full neighbourhood
+// counts as new rather than blocking: the state is searched twice, which is
+// only slower
+typedef struct {
+    std::atomic<uint64_t> *slots;
+    size_t mask;
+} TABLE;
+
+static bool table_insert(TABLE *t, uint64_t key) {
+    key = key ? key : 1;
+    size_t i = (size_t)(key ^ key >> 29) & t->mask;
+    for (int probe = 0; probe < 32; probe++, i = (i + 1) & t->mask) {
+        uint64_t cur = t->slots[i].load(std::memory_order_relaxed);
+        if (cur == key)
+            return false;
+        if (!cur) {
+            if (t->slots[i].compare_exchange_strong(cur, key, std::memory_order_relaxed))
+                return true;
+            if (cur == key)
+                return false;
+        }
+    }
+    return true;
+}
+
+// work-stealing pool //
+////////////////////////
+
+// each job is split into one contiguous range per worker. a worker claims
+// chunks from the front of its own range, then from the other workers' ranges
+// once it is empty
+#define CHUNK 16
+
+typedef struct {
+    std::atomic<int> next;
+    int end;
+    char pad[64];
+} RANGE;
+
+struct POOL {
+    int threads;
+    std::vector<std::thread> workers;
+    std::vector<RANGE> ranges;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    void (*job)(void *user, int worker, int i);
+    void *user;
+    int generation, running;
+    bool quit;
+};
+
+static void pool_work(POOL *pool, int worker) {
+    for (int k = 0; k < pool->threads; k++) {
+        RANGE *r = &pool->ranges[(worker + k) % pool->threads];
+        for (;;) {
+            int i = r->next.fetch_add(CHUNK, std::memory_order_relaxed);
+            if (i >= r->end)
+                break;
+            for (int last = std::min(i + CHUNK, r->end); i < last; i++)
+                pool->job(pool->user, worker, i);
+        }
+    }
+}
+
+static void pool_thread(POOL *pool, int worker) {
+    int generation = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pool->lock);
+            pool->wake.wait(lock, [&] { return pool->quit || pool->generation != generation; });
+            if (pool->quit)
+                return;
+            generation = pool->generation;
+        }
+        pool_work(pool, worker);
+        std::lock_guard<std::mutex> lock(pool->lock);
+        if (--pool->running == 0)
+            pool->done.notify_one();
+    }
+}
+
+static void pool_start(POOL *pool, int threads) {
+    pool->threads = threads;
+    pool->ranges = std::vector<RANGE>(threads);
+    pool->generation = pool->running = 0;
+    pool->quit = false;
+    for (int t = 1; t < threads; t++)
+        pool->workers.emplace_back(pool_thread, pool, t);
+}
+
+// runs job(user, worker, i) for i in [0, count), the calling thread is worker 0
+static void pool_run(POOL *pool, int count, void (*job)(void *, int, int), void *user) {
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        for (int t = 0; t < pool->threads; t++) {
+            pool->ranges[t].next = count * t / pool->threads;
+            pool->ranges[t].end = count * (t + 1) / pool->threads;
+        }
+        pool->job = job;
+        pool->user = user;
+        pool->running = pool->threads - 1;
+        pool->generation++;
+    }
+    pool->wake.notify_all();
+    pool_work(pool, 0);
+    std::unique_lock<std::mutex> lock(pool->lock);
+    pool->done.wait(lock, [&] { return pool->running == 0; });
+}
+
+static void pool_stop(POOL *pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->lock);
+        pool->quit = true;
+    }
+    pool->wake.notify_all();
+    for (std::thread &t : pool->workers)
+        t.join();
+}
+
+// search //
+////////////
+
+typedef struct {
+    int parent; // index in the previous layer
+    unsigned char action;
+    float score; // player height, lower is closer to the exit
+    short cell;  // player position on a 4x4 pixel grid, -1 without a player
+    uint64_t key;
+} NODE;
+
+typedef struct {
+    int level;
+    size_t state_size;
+    std::vector<unsigned char> const *actions;
+    TABLE table;
+    // the layer being expanded: its states, and per worker a scratch game and
+    // the children found
+    unsigned char *states;
+    std::vector<CelesteContext *> games;
+    std::vector<std::vector<NODE>> found;
+    std::vector<int> exits; // per worker, -1 or an action leaving the room
+    std::vector<int> exit_parents;
+    // the layer being built
+    std::vector<NODE> *next;
+    unsigned char *next_states;
+    std::atomic<long> explored;
+} SEARCH;
+
+static void expand(void *user, int worker, int parent) {
+    SEARCH *s = (SEARCH *)user;
+    CelesteContext *game = s->games[worker];
+    void const *state = s->states + parent * s->state_size;
+    std::vector<unsigned char> const &actions = *s->actions;
+    CelesteProgress before;
+    Celeste_P8_load_state(game, state);
+    Celeste_P8_get_progress(game, &before);
+
+    for (size_t a = 0; a < actions.size(); a++) {
+        if (a)
+            Celeste_P8_load_state(game, state);
+        step(game, actions[a]);
+
+        CelesteProgress after;
+        Celeste_P8_get_progress(game, &after);
+        if (after.level != s->level) {
+            if (s->exit_parents[worker] < 0 || parent < s->exit_parents[worker])
+                s->exits[worker] = actions[a], s->exit_parents[worker] = parent;
+            continue;
+        }
+        if (after.deaths != before.deaths)
+            continue;
+        uint64_t key = Celeste_P8_hash_key(game);
+        if (!table_insert(&s->table, key))
+            continue;
+        NODE n = {parent, actions[a], 1000, -1, key};
+        if (after.player) {
+            int cx = std::min(std::max((int)after.player_x / 4, 0), 31);
+            int cy = std::min(std::max((int)after.player_y / 4, 0), 31);
+            n.score = after.player_y, n.cell = (short)(cx + cy * 32);
+        }
+        s->found[worker].push_back(n);
+    }
+    s->explored.fetch_add(actions.size(), std::memory_order_relaxed);
+}
+
+// replays the kept children into the next layer's states
+static void regenerate(void *user, int worker, int i) {
+    SEARCH *s = (SEARCH *)user;
+    CelesteContext *game = s->games[worker];
+    NODE const *n = &(*s->next)[i];
+    Celeste_P8_load_state(game, s->states + n->parent * s->state_size);
+    step(game, n->action);
+    Celeste_P8_save_state(game, s->next_states + i * s->state_size);
+}
+
+static void usage(char const *prog) {
+    fprintf(stderr, "usage: %s [-l level] [-s seed] [-d frames] [-b beam] [-c cap] [-j threads] [-t bits] [-o replay]\n", prog);
+    fprintf(stderr, "  -l level   room to solve, 0-29 (default: 0)\n");
+    fprintf(stderr, "  -s seed    rng seed (default: 1)\n");
+    fprintf(stderr, "  -d frames  longest solution searched (default: 300)\n");
+    fprintf(stderr, "  -b beam    states kept per frame, 0 keeps them all for the fastest exit (default: 4096)\n");
+    fprintf(stderr, "  -c cap     states kept per 4x4 pixel spot of the room (default: 8)\n");
+    fprintf(stderr, "  -j threads worker threads (default: one per core)\n");
+    fprintf(stderr, "  -t bits    transposition table of 2^bits keys (default: 24)\n");
+    fprintf(stderr, "  -o replay  write the solution as a replay\n");
+}
+
+int main(int argc, char **argv) {
+    int level = 0;
+    unsigned seed = 1;
+    int max_frames = 300;
+    int beam = 4096;
+    int threads = (int)std::thread::hardware_concurrency();
+    int table_bits = 24;
+    int cell_cap = 8;
+    char const *out_path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-l") && i + 1 < argc) {
+            level = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            max_frames = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            beam = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-c") && i + 1 < argc) {
+            cell_cap = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            table_bits = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (level < 0 || level > 29 || beam < 0 || cell_cap <= 0 || table_bits < 8 || table_bits > 34) {
+        usage(argv[0]);
+        return 1;
+    }
+    threads = std::max(threads, 1);
+
+    // play to the room: start the game, wait for it to begin, then skip
+    // rooms until the target one is reached
+    REPLAY replay = {0};
+    replay_record_start(&replay, seed);
+    CelesteContext *game = Celeste_P8_create();
+    Celeste_P8_set_rndseed(game, seed);
+    Celeste_P8_init(game);
+    CelesteProgress progress;
+    int mask = REPLAY_SKIP;
+    for (;;) {
+        replay_record(&replay, mask);
+        step(game, mask);
+        Celeste_P8_get_progress(game, &progress);
+        if (progress.level == level)
+            break;
+        mask = progress.level == 31 ? 0 : REPLAY_SKIP;
+    }
+
+    std::vector<unsigned char> actions = make_actions();
+    SEARCH s;
+    s.level = level;
+    s.state_size = Celeste_P8_get_state_size();
+    s.actions = &actions;
+    s.table.mask = ((size_t)1 << table_bits) - 1;
+    s.table.slots = new std::atomic<uint64_t>[s.table.mask + 1]();
+    s.found.resize(threads);
+    s.exits.assign(threads, -1);
+    s.exit_parents.assign(threads, -1);
+    for (int t = 0; t < threads; t++)
+        s.games.push_back(Celeste_P8_create());
+    s.explored = 0;
+
+    // the states of the layer being expanded and of the next one, grown as
+    // needed without a beam
+    size_t layer_states = beam ? beam : 1024;
+    unsigned char *layers[2] = {(unsigned char *)malloc(layer_states * s.state_size),
+                                (unsigned char *)malloc(layer_states * s.state_size)};
+    size_t capacities[2] = {layer_states, layer_states};
+    if (!s.table.slots || !layers[0] || !layers[1]) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+    Celeste_P8_save_state(game, layers[0]);
+    table_insert(&s.table, Celeste_P8_hash_key(game));
+
+    // every layer's nodes, to walk back from the exit
+    std::vector<std::vector<NODE>> history;
+    history.push_back({NODE{-1, 0, 0, -1, 0}});
+
+    POOL pool;
+    pool_start(&pool, threads);
+    double start = now_seconds();
+    int exit_frame = -1, exit_action = 0, exit_parent = -1;
+    bool out_of_memory = false;
+    for (int frame = 0; frame < max_frames && !history.back().empty(); frame++) {
+        std::vector<NODE> &layer = history.back();
+        s.states = layers[frame & 1];
+        for (std::vector<NODE> &f : s.found)
+            f.clear();
+        pool_run(&pool, (int)layer.size(), expand, &s);
+
+        // the lowest exiting parent, so that the result does not depend on
+        // the thread timing
+        for (int t = 0; t < threads; t++)
+            if (s.exits[t] >= 0 && (exit_parent < 0 || s.exit_parents[t] < exit_parent))
+                exit_action = s.exits[t], exit_parent = s.exit_parents[t];
+        if (exit_parent >= 0) {
+            exit_frame = frame;
+            break;
+        }
+
+        std::vector<NODE> next;
+        for (std::vector<NODE> &f : s.found)
+            next.insert(next.end(), f.begin(), f.end());
+        auto closer = [](NODE const &a, NODE const &b) {
+            return a.score != b.score ? a.score < b.score : a.key < b.key;
+        };
+        std::sort(next.begin(), next.end(), closer);
+        if (beam && (int)next.size() > beam) {
+            // half the beam goes to the highest states, the other half to
+            // the highest ones of every spot
+            int per_cell[32 * 32] = {0};
+            size_t kept = beam / 2;
+            for (size_t i = 0; i < kept; i++)
+                if (next[i].cell >= 0)
+                    per_cell[next[i].cell]++;
+            for (size_t i = kept; i < next.size() && kept < (size_t)beam; i++)
+                if (next[i].cell < 0 || per_cell[next[i].cell]++ < cell_cap)
+                    next[kept++] = next[i];
+            next.resize(kept);
+        }
+
+        int to = (frame + 1) & 1;
+        if (next.size() > capacities[to]) {
+            size_t capacity = capacities[to];
+            while (capacity < next.size())
+                capacity *= 2;
+            unsigned char *states = (unsigned char *)realloc(layers[to], capacity * s.state_size);
+            if (!states) {
+                fprintf(stderr, "%s: out of memory at frame %d, %zu states\n", argv[0], frame + 1, next.size());
+                out_of_memory = true;
+                break;
+            }
+            layers[to] = states;
+            capacities[to] = capacity;
+        }
+        s.next = &next;
+        s.next_states = layers[to];
+        pool_run(&pool, (int)next.size(), regenerate, &s);
+        history.push_back(std::move(next));
+    }
+    double elapsed = now_seconds() - start;
+    pool_stop(&pool);
+
+    long explored = s.explored;
+    printf("%ld states explored in %.3f s: %.0f states/sec on %d threads\n", explored, elapsed,
+           elapsed > 0 ? explored / elapsed : 0, threads);
+
+    // with a beam, faster exits may have been pruned
+    char pruned[64] = "";
+    if (beam)
+        snprintf(pruned, sizeof pruned, " with -b %d -c %d", beam, cell_cap);
+    int status = 0;
+    if (out_of_memory) {
+        status = 1;
+    } else if (exit_frame < 0) {
+        printf("no exit from level %d found within %d frames%s\n", level, max_frames, pruned);
+        status = 2;
+    } else {
+        // walk back from the exit to the root
+        std::vector<unsigned char> solution(exit_frame + 1);
+        solution[exit_frame] = (unsigned char)exit_action;
+        for (int frame = exit_frame, i = exit_parent; frame > 0; frame--) {
+            NODE const &n = history[frame][i];
+            solution[frame - 1] = n.action;
+            i = n.parent;
+        }
+        if (beam)
+            printf("level %d exits in %d frames, the fastest found%s:", level, exit_frame + 1, pruned);
+        else
+            printf("level %d exits in %d frames, the fastest there is:", level, exit_frame + 1);
+        for (unsigned char a : solution)
+            printf(" %d", a);
+        printf("\n");
+
+        for (unsigned char a : solution) {
+            replay_record(&replay, a);
+            step(game, a);
+        }
+        Celeste_P8_get_progress(game, &progress);
+        if (progress.level == level) {
+            fprintf(stderr, "%s: the solution does not replay\n", argv[0]);
+            status = 1;
+        } else if (out_path && !replay_save(&replay, out_path)) {
+            fprintf(stderr, "%s: could not write replay '%s'\n", argv[0], out_path);
+            status = 1;
+        }
+    }
+
+    for (CelesteContext *g : s.games)
+        Celeste_P8_destroy(g);
+    Celeste_P8_destroy(game);
+    delete[] s.table.slots;
+    free(layers[0]);
+    free(layers[1]);
+    replay_free(&replay);
+    return status;
+}
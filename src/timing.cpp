@@ -0,0 +1,92 @@
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "p8gfx.h"
+#include "timing.h"
+
+#define WINDOW 256    // samples per phase
+#define REFRESH 15    // iterations between updates of the numbers shown
+
+bool timing_enabled = false;
+
+static uint64_t freq, last;
+static uint64_t totals[TIMING_PHASE_COUNT]; // of the current iteration
+static uint32_t samples[TIMING_PHASE_COUNT + 1][WINDOW]; // microseconds, the last row is the whole iteration
+static int count;
+
+// what is shown, in ms
+static float shown[TIMING_PHASE_COUNT + 1][3];
+
+static char const *const names[] = {
+#define X(name, str) str,
+    TIMING_PHASE_LIST()
+#undef X
+        "total",
+};
+
+void timing_enable(bool enable) {
+    timing_enabled = enable;
+    freq = SDL_GetPerformanceFrequency();
+    last = SDL_GetPerformanceCounter();
+    memset(totals, 0, sizeof totals);
+    memset(shown, 0, sizeof shown);
+    count = 0;
+}
+
+void timing_mark_phase(int phase) {
+    uint64_t now = SDL_GetPerformanceCounter();
+    totals[phase] += now - last;
+    last = now;
+}
+
+static void update_shown(void) {
+    int n = std::min(count, WINDOW);
+    for (int p = 0; p <= TIMING_PHASE_COUNT; p++) {
+        uint32_t sorted[WINDOW];
+        memcpy(sorted, samples[p], n * sizeof *sorted);
+        std::sort(sorted, sorted + n);
+        uint64_t sum = 0;
+        for (int i = 0; i < n; i++)
+            sum += sorted[i];
+        shown[p][0] = sorted[0] / 1000.0f;
+        shown[p][1] = sum / (float)n / 1000.0f;
+        shown[p][2] = sorted[std::max((n * 99 + 99) / 100 - 1, 0)] / 1000.0f;
+    }
+}
+
+void timing_end_frame(void) {
+    if (!timing_enabled)
+        return;
+    uint64_t total = 0;
+    for (int p = 0; p < TIMING_PHASE_COUNT; p++) {
+        samples[p][count % WINDOW] = (uint32_t)(totals[p] * 1000000 / freq);
+        total += totals[p];
+        totals[p] = 0;
+    }
+    samples[TIMING_PHASE_COUNT][count % WINDOW] = (uint32_t)(total * 1000000 / freq);
+    if (++count % REFRESH == 0)
+        update_shown();
+}
+
+// 5 characters, leading space included
+static char *format_ms(char *out, float ms) {
+    snprintf(out, 8, ms < 10 ? "%5.2f" : ms < 100 ? "%5.1f" : "%5.0f", ms);
+    return out;
+}
+
+void timing_draw(void) {
+    if (!timing_enabled)
+        return;
+    int const x = 2, y = 2, w = 4 * 22, h = 6 * (TIMING_PHASE_COUNT + 2);
+    p8gfx_rectfill(x - 1, y - 1, x + w, y + h, 0);
+    p8gfx_print("ms       min  avg  p99", x, y, 6);
+    for (int p = 0; p <= TIMING_PHASE_COUNT; p++) {
+        char line[32], a[8], b[8], c[8];
+        snprintf(line, sizeof line, "%-7s%s%s%s", names[p], format_ms(a, shown[p][0]), format_ms(b, shown[p][1]),
+                 format_ms(c, shown[p][2]));
+        p8gfx_print(line, x, y + 6 * (p + 1), p == TIMING_PHASE_COUNT ? 7 : 6);
+    }
+}
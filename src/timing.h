@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// per-phase frame timings for the sdl frontend. the main loop marks the end
+// of each phase, the time since the previous mark is added to that phase, and
+// every loop iteration becomes one sample per phase in a rolling window.
+// nothing is measured while the overlay is hidden.
+
+#define TIMING_PHASE_LIST() \
+    X(EVENTS, "events")     \
+    X(UPDATE, "update")     \
+    X(DRAW, "draw")         \
+    X(OSD, "osd")           \
+    X(PRESENT, "present")   \
+    X(FLIP, "flip")         \
+    X(SLEEP, "sleep")
+
+enum {
+#define X(name, str) TIMING_##name,
+    TIMING_PHASE_LIST()
+#undef X
+        TIMING_PHASE_COUNT
+};
+
+extern bool timing_enabled;
+
+void timing_enable(bool enable);
+
+void timing_mark_phase(int phase);
+
+static inline void timing_mark(int phase) {
+    if (timing_enabled)
+        timing_mark_phase(phase);
+}
+
+// ends the loop iteration, its phase totals become samples
+void timing_end_frame(void);
+
+// min/avg/p99 of every phase over the window, in ms, drawn with p8gfx
+void timing_draw(void);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <time.h>
+
+// helpers of the command line tools
+
+static inline double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// the next number of a xorshift generator, `*state` must not be 0. the tools
+// draw their random input from it, apart from the game rng so that it does not
+// influence the simulation
+static inline unsigned xorshift32(unsigned *state) {
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}